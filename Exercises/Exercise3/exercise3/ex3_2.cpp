@@ -0,0 +1,133 @@
+/*
+ * File:   ex3_2.cpp
+ * Author: Kyle Lierer
+ *
+ * Copyright (C) 2020 liererkt@miamioh.edu
+ */
+
+#include <unistd.h>
+#include <sched.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// The environment of this process passed on to children.
+extern char **environ;
+
+/*
+ * A benchmark that builds on the fork demo in ex3_1.cpp.  A fork
+ * gives the child a copy of the parent's virtual memory.  The pages
+ * themselves are shared (copy-on-write), but the page tables are
+ * copied, so fork gets slower as the parent uses more memory.
+ * posix_spawn, vfork, and clone(CLONE_VM | CLONE_VFORK) instead run
+ * the child in the parent's memory until it calls exec.
+ *
+ * This program grows its memory (resident set size, RSS) step by step
+ * and at each step measures how long it takes to create a child that
+ * runs "/bin/true" with each of the methods.
+ *
+ * Usage: ex3_2 [runs] [rss-in-MB ...]
+ */
+
+/** The arguments of the program run by the children. */
+char *trueArgs[] = {const_cast<char*>("/bin/true"), nullptr};
+
+/** The function run by a child created with clone. */
+int execTrue(void *) {
+    execv(trueArgs[0], trueArgs);
+    _exit(127);
+}
+
+/**
+ * Creates a child running /bin/true using the given method.
+ *
+ * \param[in] method One of "fork", "posix_spawn", "vfork", or "clone".
+ *
+ * \return The pid of the child.
+ */
+int spawnTrue(const std::string& method) {
+    int pid = -1;
+    if (method == "fork") {
+        if ((pid = fork()) == 0) {
+            execTrue(nullptr);
+        }
+    } else if (method == "posix_spawn") {
+        posix_spawn(&pid, trueArgs[0], nullptr, nullptr, trueArgs,
+                    environ);
+    } else if (method == "vfork") {
+        if ((pid = vfork()) == 0) {
+            execTrue(nullptr);
+        }
+    } else {
+        static std::vector<char> stack(64 * 1024);
+        pid = clone(execTrue, stack.data() + stack.size(),
+                    CLONE_VM | CLONE_VFORK | SIGCHLD, nullptr);
+    }
+    return pid;
+}
+
+/**
+ * Measures the time taken to create children with a given method.
+ *
+ * \param[in] method The method used to create the children.
+ *
+ * \param[in] runs The number of children to be created.
+ *
+ * \return The time (in microseconds) taken by each call, sorted.
+ */
+std::vector<double> measure(const std::string& method, int runs) {
+    using Clock = std::chrono::steady_clock;
+    std::vector<double> times;
+    for (int i = 0; i < runs; i++) {
+        const auto start = Clock::now();
+        const int pid = spawnTrue(method);
+        times.push_back(std::chrono::duration<double, std::micro>(
+            Clock::now() - start).count());
+        waitpid(pid, nullptr, 0);
+    }
+    std::sort(times.begin(), times.end());
+    return times;
+}
+
+int main(int argc, char *argv[]) {
+    const int runs = (argc > 1 ? std::stoi(argv[1]) : 500);
+    std::vector<size_t> sizes = {16, 256, 1024, 4096};
+    if (argc > 2) {
+        sizes.clear();
+        for (int i = 2; i < argc; i++) {
+            sizes.push_back(std::stoul(argv[i]));
+        }
+    }
+    std::cout << "RSS (MB)  method         p50 (us)   p90 (us)   p99 (us)\n";
+    // The memory is touched so that it is resident (and has page
+    // table entries) instead of just being reserved.
+    std::vector<char*> blocks;
+    size_t rss = 0;
+    for (size_t target : sizes) {
+        for (; rss < target; rss++) {
+            blocks.push_back(new char[1 << 20]);
+            std::memset(blocks.back(), 1, 1 << 20);
+        }
+        for (const std::string method : {"fork", "posix_spawn", "vfork",
+                                          "clone"}) {
+            const std::vector<double> t = measure(method, runs);
+            auto pct = [&t](double p) { return t[p * (t.size() - 1)]; };
+            std::cout << std::setw(8) << target << "  " << std::left
+                      << std::setw(13) << method << std::right
+                      << std::fixed << std::setprecision(1)
+                      << std::setw(9) << pct(0.5) << std::setw(11)
+                      << pct(0.9) << std::setw(11) << pct(0.99) << '\n';
+        }
+    }
+    for (char *block : blocks) {
+        delete[] block;
+    }
+    return 0;
+}
@@ -0,0 +1,123 @@
+#ifndef BUILTINS_CPP
+#define BUILTINS_CPP
+
+/**
+ * Implementation of the builtin commands of the shell.
+ *
+ * File:   Builtins.cpp
+ * Author: Kyle Lierer
+ *
+ * Copyright (C) 2020 liererkt@miamioh.edu
+ */
+
+#include <chrono>
+#include <sstream>
+#include <thread>
+#include "Builtins.h"
+
+// The builtins are used unless disabled.
+bool Builtins::enabled = true;
+
+/**
+ * The echo builtin.  Only the "-n" option (no trailing newline) is
+ * handled.  Other options (e.g., "-e") are left to /bin/echo.
+ */
+static int echoCmd(const StrVec& args, std::ostream& os) {
+    size_t i = 1;
+    bool newline = true;
+    for (; (i < args.size()) && args[i] == "-n"; i++) {
+        newline = false;
+    }
+    if (i < args.size() && args[i].size() > 1 && args[i][0] == '-') {
+        return Builtins::NotHandled;
+    }
+    for (size_t first = i; (i < args.size()); i++) {
+        os << (i == first ? "" : " ") << args[i];
+    }
+    if (newline) {
+        os << '\n';
+    }
+    os << std::flush;
+    return 0;
+}
+
+/**
+ * Returns a builtin that ignores its arguments (as true and false do)
+ * and exits with the given code.  The "--help" and "--version"
+ * options are left to the programs.
+ */
+static Builtins::Function exitWith(int code) {
+    return [code](const StrVec& args, std::ostream&) {
+        if (args.size() == 2 && (args[1] == "--help" ||
+                                 args[1] == "--version")) {
+            return Builtins::NotHandled;
+        }
+        return code;
+    };
+}
+
+/**
+ * The sleep builtin.  Sleeps for the sum of the given times, each of
+ * which is a number with an optional suffix (s, m, h, or d).
+ */
+static int sleepCmd(const StrVec& args, std::ostream&) {
+    double total = 0;
+    for (size_t i = 1; (i < args.size()); i++) {
+        std::istringstream is(args[i]);
+        double secs = -1;
+        char suffix = 's';
+        if (!(is >> secs) || secs < 0 ||
+            (!is.eof() && !(is >> suffix && is.peek() == EOF))) {
+            return Builtins::NotHandled;  // Let sleep report the error
+        }
+        switch (suffix) {
+        case 'd': secs *= 24;  // Fall through
+        case 'h': secs *= 60;  // Fall through
+        case 'm': secs *= 60;  // Fall through
+        case 's': break;
+        default: return Builtins::NotHandled;
+        }
+        total += secs;
+    }
+    if (args.size() < 2) {
+        return Builtins::NotHandled;  // Let sleep print the usage
+    }
+    std::this_thread::sleep_for(std::chrono::duration<double>(total));
+    return 0;
+}
+
+std::unordered_map<std::string, Builtins::Entry>&
+Builtins::table() {
+    static std::unordered_map<std::string, Entry> builtins = {
+        {"echo",  {echoCmd,     false}},
+        {"true",  {exitWith(0), false}},
+        {"false", {exitWith(1), false}},
+        {"sleep", {sleepCmd,    true}},
+    };
+    return builtins;
+}
+
+void
+Builtins::add(const std::string& name, Function func, bool blocking) {
+    table()[name] = {func, blocking};
+}
+
+bool
+Builtins::run(const StrVec& args, std::ostream& os, bool serial,
+              int& status) {
+    if (!enabled || args.empty()) {
+        return false;
+    }
+    const auto entry = table().find(args[0]);
+    if (entry == table().end() || (entry->second.blocking && !serial)) {
+        return false;
+    }
+    const int code = entry->second.func(args, os);
+    if (code == NotHandled) {
+        return false;
+    }
+    status = (code & 0xff) << 8;  // As from waitpid for a normal exit
+    return true;
+}
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef BUILTINS_H
+#define BUILTINS_H
+
+/**
+ * A table of commands that the shell runs in-process (without
+ * forking a child), as bash does for its builtins.  This makes
+ * scripts with many trivial commands (e.g., echo) much faster.
+ *
+ * File:   Builtins.h
+ * Author: Kyle Lierer
+ *
+ * Copyright (C) 2020 liererkt@miamioh.edu
+ */
+
+#include <functional>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include "ChildProcess.h"
+
+/**
+ * The builtin commands.  Each builtin must produce the same output
+ * and exit code as the program with the same name.  A builtin can
+ * decline to handle arguments it does not support (e.g., "echo -e"),
+ * in which case the program is run as usual.  The table initially has
+ * echo, true, false, and sleep.
+ */
+class Builtins {
+public:
+    /** The value returned by a builtin to have the program run
+        instead. */
+    static const int NotHandled = -1;
+
+    /**
+     * A builtin command.  The first argument is the name of the
+     * command, as with execvp.  The output is written to the given
+     * stream.  Returns the exit code (0 to 255) or NotHandled.
+     */
+    using Function = std::function<int(const StrVec& args,
+                                       std::ostream& os)>;
+
+    /**
+     * Adds (or replaces) a builtin command.
+     *
+     * \param[in] name The name of the command.
+     *
+     * \param[in] func The function that runs the command.
+     *
+     * \param[in] blocking If true, the builtin takes time to run
+     * (e.g., sleep).  Such builtins are only used when the shell
+     * waits for each command anyway (see run).
+     */
+    static void add(const std::string& name, Function func,
+                    bool blocking = false);
+
+    /**
+     * Runs a command in-process if it is a builtin.
+     *
+     * \param[in] args The command and its arguments.
+     *
+     * \param[out] os The stream to where the output is written.
+     *
+     * \param[in] serial If true, the shell runs just one command at a
+     * time, so that builtins that block can be used.
+     *
+     * \param[out] status The exit status (in the same format as from
+     * waitpid) if the command was run.
+     *
+     * \return True if the command was run as a builtin.
+     */
+    static bool run(const StrVec& args, std::ostream& os, bool serial,
+                    int& status);
+
+    /** Enables or disables all builtins (they are enabled by default).
+        When disabled, every command is run as a child process. */
+    static void setEnabled(bool enable) { enabled = enable; }
+
+private:
+    /** An entry in the table of builtins. */
+    struct Entry {
+        Function func;  ///< The function that runs the command
+        bool blocking;  ///< If the builtin takes time to run
+    };
+
+    /** Returns the table of builtins, initially with the default
+        ones. */
+    static std::unordered_map<std::string, Entry>& table();
+
+    /** Whether the builtins are used. */
+    static bool enabled;
+};
+
+#endif
@@ -9,12 +9,101 @@
  */
 
 // All the necessary #includes are already here
+#include <fcntl.h>
+#include <poll.h>
 #include <unistd.h>
+#include <sched.h>
+#include <signal.h>
+#include <spawn.h>
 #include <sys/wait.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
 #include <stdexcept>
 #include <vector>
 #include "ChildProcess.h"
 
+// The environment of this process passed on to children.
+extern char **environ;
+
+/** The size of the stack used by the child with CloneVM.  The child
+    only calls execvp (or _exit) on this stack. */
+const size_t CloneStackSize = 64 * 1024;
+
+/** The size of the buffers used by communicate.  Reading and writing
+    the pipes in blocks of their default capacity (64 KiB) keeps the
+    number of system calls low. */
+const size_t PipeBufSize = 64 * 1024;
+
+// The default method used to create child processes.
+SpawnMethod ChildProcess::spawnMethod = SpawnMethod::PosixSpawn;
+
+/**
+ * The information shared between the parent and a child that is
+ * running in the parent's memory (VFork and CloneVM).  The child
+ * reports the reason execvp failed via this structure.
+ */
+struct ExecArgs {
+    /** The nullptr-terminated list of arguments for execvp. */
+    char **argv;
+    /** The signal mask to be set in the child before execvp. */
+    const sigset_t *mask;
+    /** The errno set by a failed execvp.  Zero if execvp worked. */
+    int error;
+    /** The descriptors for stdin, stdout, and stderr (-1 to inherit) */
+    const int *childFds;
+};
+
+/**
+ * Makes the given descriptors the stdin, stdout, and stderr of the
+ * calling (child) process.  Only async-signal-safe calls are used so
+ * that this can be called from a child sharing the parent's memory.
+ *
+ * \param[in] childFds The descriptors for the 3 streams.  Entries
+ * that are -1 are left as they are.
+ */
+static void redirect(const int *childFds) {
+    for (int i = 0; (i < 3); i++) {
+        if (childFds[i] != -1) {
+            dup2(childFds[i], i);
+        }
+    }
+}
+
+/**
+ * Returns the signal mask for a child: the given mask without
+ * SIGCHLD, which a ChildProcessGroup may have blocked in the parent.
+ * Programs expect to start with it unblocked (e.g., a shell that
+ * waits for its own children).
+ *
+ * \param[in] mask The signal mask of the parent.
+ *
+ * \return The mask to be set in the child before execvp.
+ */
+static sigset_t childSigMask(const sigset_t& mask) {
+    sigset_t childMask = mask;
+    sigdelset(&childMask, SIGCHLD);
+    return childMask;
+}
+
+/**
+ * The function run by a child that shares memory with the parent.
+ * It must not return or modify anything other than args->error.
+ *
+ * \param[in,out] arg Pointer to the ExecArgs for the child.
+ *
+ * \return This function never returns.
+ */
+static int execChild(void *arg) {
+    ExecArgs *args = static_cast<ExecArgs*>(arg);
+    pthread_sigmask(SIG_SETMASK, args->mask, nullptr);
+    redirect(args->childFds);
+    execvp(args->argv[0], args->argv);
+    args->error = errno;  // Seen by the parent once we exit.
+    _exit(127);
+}
+
 /** NOTE: Unlike Java, C++ does not require class names and file names
  * should match.  Hence when defining methods pertaining to a specific
  * class, the class
@@ -37,8 +126,9 @@ ChildProcess::myExec(StrVec argList) {
 }
 
 // Implement the constructor
-ChildProcess::ChildProcess() : childPid(-1) {
-    // childPid is initialized and not assigned!  Hence body is empty.
+ChildProcess::ChildProcess() : childPid(-1), stdioFd{-1, -1, -1} {
+    // Instance variables are initialized and not assigned!  Hence
+    // body is empty.
 }
 
 // Implement the destructor.  The destructor is an empty method
@@ -57,25 +147,308 @@ ChildProcess::~ChildProcess() {
 // myExec in the child process and just return the childPid in parent.
 int
 ChildProcess::forkNexec(const StrVec& strVec) {
-    // Fork and save the pid of the child process
-    childPid = fork();
-    // Call the myExec helper method in the child
-    if (childPid == 0) {
-        // We are in the child process
-        myExec(strVec);
+    const int inherit[3] = {-1, -1, -1};
+    return forkNexec(strVec, inherit);
+}
+
+int
+ChildProcess::forkNexec(const StrVec& strVec, const int childFds[3]) {
+    using Clock = std::chrono::steady_clock;
+    stats     = ChildStats();
+    startTime = Clock::now();
+    if (spawnMethod != SpawnMethod::Fork) {
+        // These methods return once the child has called execvp.
+        childPid = spawn(strVec, childFds);
+    } else {
+        // The write end of this pipe is closed when the child calls
+        // execvp (or exits), so reading it waits for the exec.
+        int execPipe[2];
+        const bool sync = (pipe2(execPipe, O_CLOEXEC) == 0);
+        // Fork and save the pid of the child process
+        childPid = fork();
+        // Call the myExec helper method in the child
+        if (childPid == 0) {
+            // We are in the child process
+            sigset_t mask;
+            pthread_sigmask(SIG_SETMASK, nullptr, &mask);
+            mask = childSigMask(mask);
+            pthread_sigmask(SIG_SETMASK, &mask, nullptr);
+            redirect(childFds);
+            myExec(strVec);
+        }
+        // Control drops here only in the parent process!
+        if (sync) {
+            close(execPipe[1]);
+            char dummy;
+            while (read(execPipe[0], &dummy, 1) == -1 && errno == EINTR) {
+                // Interrupted by a signal. Keep waiting for the exec.
+            }
+            close(execPipe[0]);
+        }
+    }
+    stats.spawnUsec = std::chrono::duration<double, std::micro>(
+        Clock::now() - startTime).count();
+    return childPid;
+}
+
+int
+ChildProcess::forkNexecIO(const StrVec& argList, int pipes) {
+    // The child's end of each pipe is at index 0 for stdin (it reads)
+    // and at index 1 for stdout/stderr (it writes).  All the ends
+    // are close-on-exec; only the copies made by dup2 in the child
+    // remain open across exec.
+    int childFds[3] = {-1, -1, -1};
+    bool ok = true;
+    for (int i = 0; (i < 3 && ok); i++) {
+        int fds[2];
+        if (!(pipes & (1 << i))) {
+            continue;
+        } else if (pipe2(fds, O_CLOEXEC) == -1) {
+            std::cerr << "Call to pipe2 failed: " << std::strerror(errno)
+                      << std::endl;
+            ok = false;
+            break;
+        }
+        childFds[i] = fds[i == 0 ? 0 : 1];
+        stdioFd[i]  = fds[i == 0 ? 1 : 0];
+        fcntl(stdioFd[i], F_SETFL, O_NONBLOCK);
+    }
+    childPid = -1;
+    if (ok) {
+        forkNexec(argList, childFds);
+    }
+    // The child has its own copies of its ends of the pipes.
+    for (int fd : childFds) {
+        if (fd != -1) {
+            close(fd);
+        }
+    }
+    if (childPid == -1) {
+        closePipes();
     }
-    // Control drops here only in the parent process!
     return childPid;
 }
 
+bool
+ChildProcess::communicate(const std::string& input,
+                          const OutputSink& onStdout,
+                          const OutputSink& onStderr) {
+    size_t pos = 0;
+    auto source = [&input, &pos](char *buf, size_t size) {
+        const size_t len = std::min(size, input.size() - pos);
+        input.copy(buf, len, pos);
+        pos += len;
+        return len;
+    };
+    return communicate(source, onStdout, onStderr);
+}
+
+bool
+ChildProcess::communicate(const InputSource& input,
+                          const OutputSink& onStdout,
+                          const OutputSink& onStderr) {
+    // Writing to a pipe whose reader has exited raises SIGPIPE, which
+    // would kill this process.  Block it while we write and discard
+    // any that is raised (the write then fails with EPIPE instead).
+    sigset_t pipeSig, mask;
+    sigemptyset(&pipeSig);
+    sigaddset(&pipeSig, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &pipeSig, &mask);
+    const OutputSink sinks[3] = {nullptr, onStdout, onStderr};
+    std::vector<char> inBuf(PipeBufSize), outBuf(PipeBufSize);
+    size_t inPos = 0, inLen = 0;
+    bool ok = true;
+    auto closeFd = [this](int i) { close(stdioFd[i]); stdioFd[i] = -1; };
+    if (stdioFd[0] != -1 && !input) {
+        closeFd(0);  // No input for the child.
+    }
+    while (stdioFd[0] != -1 || stdioFd[1] != -1 || stdioFd[2] != -1) {
+        pollfd fds[3];
+        int streams[3], count = 0;
+        for (int i = 0; (i < 3); i++) {
+            if (stdioFd[i] != -1) {
+                const short events = (i == 0 ? POLLOUT : POLLIN);
+                fds[count]       = {stdioFd[i], events, 0};
+                streams[count++] = i;
+            }
+        }
+        if (poll(fds, count, -1) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ok = false;
+            break;
+        }
+        for (int j = 0; (j < count); j++) {
+            const int i = streams[j];
+            if (fds[j].revents == 0) {
+                continue;
+            } else if (i == 0) {
+                // Refill the input buffer as needed and write as much
+                // as the pipe accepts.
+                if (inPos == inLen) {
+                    inPos = 0;
+                    inLen = input(inBuf.data(), inBuf.size());
+                }
+                const ssize_t n = (inLen == 0 ? 0 :
+                                   write(stdioFd[0], &inBuf[inPos],
+                                         inLen - inPos));
+                if (n > 0) {
+                    inPos += n;
+                } else if (n == 0 || errno == EPIPE) {
+                    closeFd(0);  // End of input or child stopped reading
+                } else if (errno != EAGAIN && errno != EINTR) {
+                    closeFd(0);
+                    ok = false;
+                }
+            } else {
+                const ssize_t n = read(stdioFd[i], outBuf.data(),
+                                       outBuf.size());
+                if (n > 0) {
+                    if (sinks[i]) {
+                        sinks[i](outBuf.data(), n);
+                    }
+                } else if (n == 0) {
+                    closeFd(i);  // End of the stream
+                } else if (errno != EAGAIN && errno != EINTR) {
+                    closeFd(i);
+                    ok = false;
+                }
+            }
+        }
+    }
+    // Discard a pending SIGPIPE before restoring the signal mask.
+    const timespec noWait = {0, 0};
+    while (sigtimedwait(&pipeSig, nullptr, &noWait) == SIGPIPE) {
+        // Nothing else to do.
+    }
+    pthread_sigmask(SIG_SETMASK, &mask, nullptr);
+    return ok;
+}
+
+void
+ChildProcess::closePipes() {
+    for (int& fd : stdioFd) {
+        if (fd != -1) {
+            close(fd);
+            fd = -1;
+        }
+    }
+}
+
+int
+ChildProcess::spawn(const StrVec& argList, const int childFds[3]) const {
+    std::vector<char*> argv;    // list of pointers to args
+    for (const auto& s : argList) {
+        argv.push_back(const_cast<char*>(s.c_str()));
+    }
+    argv.push_back(nullptr);
+    int pid = -1, error = 0;
+    if (spawnMethod == SpawnMethod::PosixSpawn) {
+        // The redirections are done by the child as file actions.
+        posix_spawn_file_actions_t actions;
+        posix_spawn_file_actions_init(&actions);
+        for (int i = 0; (i < 3); i++) {
+            if (childFds[i] != -1) {
+                posix_spawn_file_actions_adddup2(&actions, childFds[i], i);
+            }
+        }
+        sigset_t mask;
+        pthread_sigmask(SIG_SETMASK, nullptr, &mask);
+        mask = childSigMask(mask);
+        posix_spawnattr_t attr;
+        posix_spawnattr_init(&attr);
+        posix_spawnattr_setsigmask(&attr, &mask);
+        posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK);
+        error = posix_spawnp(&pid, argv[0], &actions, &attr,
+                             argv.data(), environ);
+        posix_spawnattr_destroy(&attr);
+        posix_spawn_file_actions_destroy(&actions);
+    } else {
+        // Block signals so that no signal handler runs in the child
+        // while it is using the parent's memory.  The child sets its
+        // own mask before calling execvp.
+        sigset_t all, mask;
+        sigfillset(&all);
+        pthread_sigmask(SIG_SETMASK, &all, &mask);
+        const sigset_t childMask = childSigMask(mask);
+        ExecArgs args = {argv.data(), &childMask, 0, childFds};
+        if (spawnMethod == SpawnMethod::VFork) {
+            // The parent is suspended until the child calls execvp or
+            // _exit, so the child can use the parent's stack.
+            pid = vfork();
+            if (pid == 0) {
+                execChild(&args);
+            }
+        } else {
+            std::vector<char> stack(CloneStackSize);
+            pid = clone(execChild, stack.data() + stack.size(),
+                        CLONE_VM | CLONE_VFORK | SIGCHLD, &args);
+        }
+        pthread_sigmask(SIG_SETMASK, &mask, nullptr);
+        error = (pid == -1 ? errno : args.error);
+        if (pid != -1 && error != 0) {
+            waitpid(pid, nullptr, 0);  // Reap the child that failed.
+        }
+    }
+    if (error != 0) {
+        std::cerr << "Call to execvp failed for " << argList[0] << ": "
+                  << std::strerror(error) << std::endl;
+        return -1;
+    }
+    return pid;
+}
+
+void
+ChildProcess::setSpawnMethod(SpawnMethod method) {
+    spawnMethod = method;
+}
+
+SpawnMethod
+ChildProcess::getSpawnMethod() {
+    return spawnMethod;
+}
+
+SpawnMethod
+ChildProcess::toSpawnMethod(const std::string& name) {
+    if (name == "fork") {
+        return SpawnMethod::Fork;
+    } else if (name == "posix_spawn") {
+        return SpawnMethod::PosixSpawn;
+    } else if (name == "vfork") {
+        return SpawnMethod::VFork;
+    } else if (name == "clone") {
+        return SpawnMethod::CloneVM;
+    }
+    throw std::invalid_argument("Invalid spawn method: " + name);
+}
+
 // Use the comments in the header to implement the wait method.  This
-// is a relatively simple method which uses waitpid call to get
-// exitCode as shown in Slide #6 of ForkAndExec.pdf
+// is a relatively simple method which uses wait4 call to get
+// exitCode (as with waitpid in Slide #6 of ForkAndExec.pdf) along
+// with the resources used by the child.
 int
-ChildProcess::wait() const {
+ChildProcess::wait() {
     int exitCode = 0;  // Child process's exit code
-    waitpid(childPid, &exitCode, 0);  // wait for child to finish
+    struct rusage usage = {};
+    wait4(childPid, &exitCode, 0, &usage);  // wait for child to finish
+    setExitInfo(exitCode, usage);
     return exitCode;
 }
 
+void
+ChildProcess::setExitInfo(int status, const struct rusage& usage) {
+    auto seconds = [](const timeval& tv) {
+        return tv.tv_sec + tv.tv_usec / 1e6;
+    };
+    stats.status     = status;
+    stats.wallSec    = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - startTime).count();
+    stats.userSec    = seconds(usage.ru_utime);
+    stats.sysSec     = seconds(usage.ru_stime);
+    stats.maxRssKb   = usage.ru_maxrss;
+    stats.volCtxSw   = usage.ru_nvcsw;
+    stats.involCtxSw = usage.ru_nivcsw;
+}
+
 #endif
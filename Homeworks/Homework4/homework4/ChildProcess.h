@@ -9,12 +9,55 @@
  * Copyright (C) 2020 raodm@miamiOH.edu
  */
 
+#include <sys/resource.h>
+#include <chrono>
+#include <cstddef>
+#include <functional>
 #include <string>
 #include <vector>
 
 // A convenience shortcut to a vector-of-strings
 using StrVec = std::vector<std::string>;
 
+/**
+ * The different system calls that can be used to create a child
+ * process.  A plain fork copies the page tables of the parent, which
+ * gets slower as the parent grows.  The other methods share the
+ * parent's memory until the child calls exec, so their cost does not
+ * depend on the size of the parent.
+ */
+enum class SpawnMethod {
+    Fork,        ///< fork() followed by execvp in the child
+    PosixSpawn,  ///< posix_spawnp()
+    VFork,       ///< vfork() followed by execvp in the child
+    CloneVM      ///< clone(CLONE_VM | CLONE_VFORK) with its own stack
+};
+
+/**
+ * The resource usage and timing of a child process.  The values are
+ * filled in when the child is reaped (using wait4).
+ */
+struct ChildStats {
+    /** The exit status of the child (as returned by waitpid). */
+    int status = 0;
+    /** Time (in microseconds) taken to create the child and start
+        the program (until exec succeeded or failed). */
+    double spawnUsec = 0;
+    /** Time (in seconds) from the start of the spawn until the child
+        was reaped. */
+    double wallSec = 0;
+    /** CPU time (in seconds) used by the child in user mode. */
+    double userSec = 0;
+    /** CPU time (in seconds) used by the child in the kernel. */
+    double sysSec = 0;
+    /** Peak resident set size (memory) of the child in kilobytes. */
+    long maxRssKb = 0;
+    /** Context switches because the child waited (e.g., for I/O). */
+    long volCtxSw = 0;
+    /** Context switches because the child was preempted. */
+    long involCtxSw = 0;
+};
+
 // ------------------------------------------------------------------- //
 // ****  NOTE: NEVER NEVER put "using namespace" IN A HEADER FILE  *** //
 // ------------------------------------------------------------------- //
@@ -26,6 +69,25 @@ using StrVec = std::vector<std::string>;
  */
 class ChildProcess {
 public:
+    /** Flags to select the standard streams of the child that are
+        connected to pipes by forkNexecIO.  The other streams are
+        inherited from this process. */
+    enum Pipes {
+        StdinPipe  = 1,
+        StdoutPipe = 2,
+        StderrPipe = 4,
+        AllPipes   = StdinPipe | StdoutPipe | StderrPipe
+    };
+
+    /** A callback that supplies the input for the child.  It copies
+        up to size bytes into buf and returns the number of bytes
+        copied.  Returning zero ends the input (closing the child's
+        stdin). */
+    using InputSource = std::function<size_t(char *buf, size_t size)>;
+
+    /** A callback that consumes a block of output from the child. */
+    using OutputSink = std::function<void(const char *data, size_t len)>;
+
     /** A simple default (no-argument) constructor.  This constructor
         merely initializes (so the body of the method should be
         empty!) the childPid instance variable to -1.
@@ -43,8 +105,11 @@ public:
 
     /** The primary method in this class that:
 
-        1. First uses the fork system call to create a child process.
-        2. In the child process it calls myExec to execute a program.
+        1. First creates a child process using the spawn method set
+           via setSpawnMethod (by default posix_spawn).
+        2. In the child process it executes the program, with the
+           signal mask of the calling thread except that SIGCHLD is
+           unblocked (see ChildProcessGroup).
         3. In the parent process, it stores the value in childPid and
            returns the childPid value.
 
@@ -52,19 +117,127 @@ public:
         first entry is assumed to be the command to be executed. 
           
         \return This method returns the pid value of the child process
-        forked by this method.
+        forked by this method.  With methods other than Fork, failure
+        to execute the program is detected in the parent: an error is
+        printed and -1 is returned.
     */
     int forkNexec(const StrVec& argList);
 
+    /** Similar to forkNexec, but the child uses the given descriptors
+        as its stdin, stdout, and stderr.  This is used to connect
+        children directly to each other (e.g., in a pipeline).
+
+        \param[in] argList The list of command-line arguments.
+
+        \param[in] childFds The descriptors to become the stdin,
+        stdout, and stderr of the child.  Entries that are -1 are
+        inherited from this process.  The descriptors should be
+        close-on-exec so that other children do not inherit them.
+
+        \return The pid of the child process or -1 on errors.
+    */
+    int forkNexec(const StrVec& argList, const int childFds[3]);
+
+    /** Similar to forkNexec, but also connects the selected standard
+        streams of the child to pipes.  The ends of the pipes in this
+        process are non-blocking so that the streams can be serviced
+        together using communicate (or poll on the descriptors).  This
+        avoids the deadlock where the child blocks writing output
+        that is not being read while this process blocks writing
+        input that is not being read.
+
+        \param[in] argList The list of command-line arguments.
+
+        \param[in] pipes The streams to be redirected (an or of the
+        Pipes flags).
+
+        
+eturn The pid of the child process or -1 on errors.
+    */
+    int forkNexecIO(const StrVec& argList, int pipes = AllPipes);
+
+    /**
+     * Streams data to and from a child started with forkNexecIO.
+     * The input is written to the child's stdin while its stdout and
+     * stderr are read, all multiplexed with poll, until the child
+     * closes its output streams.  The pipes are closed by this
+     * method.  The child should still be reaped with wait.
+     *
+     * \param[in] input The source of data for the child's stdin.
+     * If the child exits (or closes its stdin) before all the input
+     * is written, the rest of the input is not read.
+     *
+     * \param[in] onStdout The callback for data read from the
+     * child's stdout.  If it is nullptr the data is discarded.
+     *
+     * \param[in] onStderr The callback for data read from the
+     * child's stderr.  If it is nullptr the data is discarded.
+     *
+     * \return False if an I/O error occurred.
+     */
+    bool communicate(const InputSource& input, const OutputSink& onStdout,
+                     const OutputSink& onStderr = nullptr);
+
+    /** Convenience method to feed a string to the child's stdin.
+        See the other version of communicate for details. */
+    bool communicate(const std::string& input, const OutputSink& onStdout,
+                     const OutputSink& onStderr = nullptr);
+
+    /** Returns the (non-blocking) end of the pipe connected to the
+        child's stdin (0), stdout (1), or stderr (2).  The value is -1
+        if the stream is not redirected or has been closed. */
+    int getPipeFd(int stream) const { return stdioFd[stream]; }
+
+    /** Closes this process' ends of all the pipes to the child. */
+    void closePipes();
+
+    /** Sets the method used by forkNexec to create child processes.
+        The method applies to all ChildProcess objects.
+
+        \param[in] method The spawn method to be used.
+    */
+    static void setSpawnMethod(SpawnMethod method);
+
+    /** Returns the method used by forkNexec to create children. */
+    static SpawnMethod getSpawnMethod();
+
+    /**
+     * Converts the name of a spawn method ("fork", "posix_spawn",
+     * "vfork", or "clone") to the corresponding SpawnMethod.
+     *
+     * \param[in] name The name of the method.
+     *
+     * \return The spawn method.  An std::invalid_argument exception
+     * is thrown if the name is invalid.
+     */
+    static SpawnMethod toSpawnMethod(const std::string& name);
+
+    /** Returns the pid of the child process (-1 if not started). */
+    int getPid() const { return childPid; }
+
     /** Helper method to wait for child process to finish.  This
-        method calls the waitpid system call. It obtains the exit code
-        of the child process from the 2nd argument of the waitpid
-        system call.
+        method calls the wait4 system call. It obtains the exit code
+        of the child process from the 2nd argument of the wait4
+        system call and its resource usage from the 4th argument.
 
         \return This method returns the exit code of the child
         process.
     */
-    int wait() const;
+    int wait();
+
+    /** Records the exit status and resource usage of the child once
+        it has been reaped.  This is called by wait, or by the code
+        that reaps the child instead (e.g., ChildProcessGroup).
+
+        \param[in] status The exit status from wait4.
+
+        \param[in] usage The resource usage from wait4.
+    */
+    void setExitInfo(int status, const struct rusage& usage);
+
+    /** Returns the resource usage and timing of the child.  Only the
+        spawn time is valid until the child has been reaped. */
+    const ChildStats& getStats() const { return stats; }
     
 protected:
     /** A helper method to setup pointers and call execvp system call.
@@ -77,13 +250,42 @@ protected:
         first entry is assumed to be the command to be executed.
     */
     void myExec(StrVec argList);
+
+    /** Creates the child process without copying the parent's memory
+        (i.e., using PosixSpawn, VFork, or CloneVM).
+
+        \param[in] argList The list of command-line arguments.
+
+        \param[in] childFds The descriptors to become the stdin,
+        stdout, and stderr of the child (-1 to inherit).
+
+        \return The pid of the child or -1 if the program could not
+        be executed.
+    */
+    int spawn(const StrVec& argList, const int childFds[3]) const;
     
 private:
-    /** The only instance variable in this class.  It is initialized
-        to -1 in the constructor.  The value is changed by the
-        forkNexec method.
+    /** The pid of the child process.  It is initialized to -1 in the
+        constructor.  The value is changed by the forkNexec method.
     */
     int childPid;
+
+    /** This process' ends of the pipes connected to the stdin,
+        stdout, and stderr of the child (-1 if not redirected).  Since
+        objects of this class are copied, the pipes are not closed by
+        the destructor but by communicate or closePipes. */
+    int stdioFd[3];
+
+    /** The time at which the child was started, to compute the wall
+        clock time of the child. */
+    std::chrono::steady_clock::time_point startTime;
+
+    /** The resource usage and timing of the child. */
+    ChildStats stats;
+
+    /** The method used by forkNexec to create child processes.  It is
+        shared by all the objects of this class. */
+    static SpawnMethod spawnMethod;
 };
 
 #endif
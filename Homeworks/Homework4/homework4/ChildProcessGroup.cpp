@@ -0,0 +1,156 @@
+#ifndef CHILD_PROCESS_GROUP_CPP
+#define CHILD_PROCESS_GROUP_CPP
+
+/**
+ * Implementation of the class to wait for a group of children in
+ * completion order.
+ *
+ * File:   ChildProcessGroup.cpp
+ * Author: Kyle Lierer
+ *
+ * Copyright (C) 2020 liererkt@miamioh.edu
+ */
+
+#include <signal.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <cerrno>
+#include <vector>
+#include "ChildProcessGroup.h"
+
+/** The maximum number of events processed per call to epoll_wait. */
+const int MaxEvents = 64;
+
+/**
+ * Helper method to obtain a pidfd for a process.  glibc (before 2.36)
+ * does not have a wrapper for this system call.
+ *
+ * \param[in] pid The process to be watched.
+ *
+ * \return The pidfd or -1 on errors (e.g., ENOSYS on old kernels).
+ */
+static int pidfdOpen(int pid) {
+#ifdef SYS_pidfd_open
+    return syscall(SYS_pidfd_open, pid, 0);
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+ChildProcessGroup::ChildProcessGroup() :
+    epollFd(epoll_create1(EPOLL_CLOEXEC)) {
+    // Check if the kernel supports pidfds using our own pid.
+    const int testFd = pidfdOpen(getpid());
+    if (testFd != -1) {
+        close(testFd);
+        return;
+    }
+    // Fall back to receiving SIGCHLD via a signalfd.
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    pthread_sigmask(SIG_BLOCK, &mask, &oldMask);
+    sigFd = signalfd(-1, &mask, SFD_CLOEXEC | SFD_NONBLOCK);
+    epoll_event event = {};
+    event.events  = EPOLLIN;
+    event.data.fd = sigFd;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, sigFd, &event);
+}
+
+ChildProcessGroup::~ChildProcessGroup() {
+    for (const auto& child : running) {
+        if (child.second.second != -1) {
+            close(child.second.second);
+        }
+    }
+    if (sigFd != -1) {
+        close(sigFd);
+        pthread_sigmask(SIG_SETMASK, &oldMask, nullptr);
+    }
+    close(epollFd);
+}
+
+bool
+ChildProcessGroup::add(const ChildProcess& child) {
+    const int pid = child.getPid();
+    if (pid <= 0) {
+        return false;
+    }
+    if (sigFd != -1) {
+        running.emplace(pid, std::make_pair(child, -1));
+        return true;
+    }
+    const int pidFd = pidfdOpen(pid);
+    if (pidFd == -1) {
+        return false;
+    }
+    epoll_event event = {};
+    event.events   = EPOLLIN;
+    event.data.u64 = pid;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, pidFd, &event);
+    running.emplace(pid, std::make_pair(child, pidFd));
+    return true;
+}
+
+void
+ChildProcessGroup::reap(int timeout) {
+    epoll_event events[MaxEvents];
+    const int count = epoll_wait(epollFd, events, MaxEvents, timeout);
+    for (int i = 0; i < count; i++) {
+        int exitCode = 0;
+        struct rusage usage = {};
+        if (sigFd != -1) {
+            // Drain the signals and then check all the children, as
+            // several SIGCHLDs may have been merged into one.
+            signalfd_siginfo info;
+            while (read(sigFd, &info, sizeof(info)) > 0) {}
+            for (auto child = running.begin(); child != running.end();) {
+                if (wait4(child->first, &exitCode, WNOHANG, &usage) > 0) {
+                    child->second.first.setExitInfo(exitCode, usage);
+                    finished.push_back(child->second.first);
+                    child = running.erase(child);
+                } else {
+                    child++;
+                }
+            }
+            continue;
+        }
+        // The pidfd of this child is readable, i.e., it has exited.
+        const int pid = events[i].data.u64;
+        auto child = running.find(pid);
+        if (child == running.end()) {
+            continue;  // Already reaped (see below).
+        }
+        wait4(pid, &exitCode, 0, &usage);
+        // The pidfd is removed from epoll explicitly as closing it is
+        // not enough: a child being spawned may still have a copy of
+        // the descriptor (until its exec closes it), and epoll keeps
+        // watching the pidfd until all copies are closed.
+        const int pidFd = child->second.second;
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, pidFd, nullptr);
+        close(pidFd);
+        child->second.first.setExitInfo(exitCode, usage);
+        finished.push_back(child->second.first);
+        running.erase(child);
+    }
+}
+
+ChildProcess
+ChildProcessGroup::waitAny(int timeout) {
+    if (finished.empty() && !running.empty()) {
+        reap(timeout);
+    }
+    if (finished.empty()) {
+        return ChildProcess();
+    }
+    const ChildProcess result = finished.front();
+    finished.pop_front();
+    return result;
+}
+
+#endif
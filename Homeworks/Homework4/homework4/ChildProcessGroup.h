@@ -0,0 +1,105 @@
+#ifndef CHILD_PROCESS_GROUP_H
+#define CHILD_PROCESS_GROUP_H
+
+/**
+ * A class to wait for a group of child processes in the order in
+ * which they finish (rather than the order in which they started).
+ *
+ * File:   ChildProcessGroup.h
+ * Author: Kyle Lierer
+ *
+ * Copyright (C) 2020 liererkt@miamioh.edu
+ */
+
+#include <signal.h>
+#include <deque>
+#include <unordered_map>
+#include <utility>
+#include "ChildProcess.h"
+
+/**
+ * A group of running child processes.  Each child is watched with a
+ * pidfd (a file descriptor that becomes readable when the process
+ * exits) registered with an epoll instance, so that waiting for any
+ * one of many children costs O(1) and no thread is blocked per
+ * child.  On kernels without pidfd_open, SIGCHLD is received via a
+ * signalfd instead.  The epoll descriptor can be added to an event
+ * loop (see fd()) to be notified when a child finishes.
+ *
+ * \note When pidfds are not supported the group blocks SIGCHLD in the
+ * calling thread (until the group is destroyed).  Create the group
+ * before starting its children.  The children start with SIGCHLD
+ * unblocked (see ChildProcess::forkNexec).
+ */
+class ChildProcessGroup {
+public:
+    /** Creates an empty group. */
+    ChildProcessGroup();
+
+    /** Closes the descriptors and restores the signal mask.
+        Children still running are not waited for (just as with
+        ChildProcess). */
+    ~ChildProcessGroup();
+
+    // The group owns file descriptors and cannot be copied.
+    ChildProcessGroup(const ChildProcessGroup&) = delete;
+    ChildProcessGroup& operator=(const ChildProcessGroup&) = delete;
+
+    /**
+     * Adds a child process (that has been started) to the group.
+     *
+     * \param[in] child The child process to be watched.
+     *
+     * \return True if the child was added.  False if the child was
+     * not started (e.g., forkNexec failed).
+     */
+    bool add(const ChildProcess& child);
+
+    /**
+     * Waits for any child in the group to finish and reaps it.
+     * Children are returned in the order in which they finish.
+     *
+     * \param[in] timeout The maximum time to wait in milliseconds.
+     * -1 waits until a child finishes.  0 just checks.
+     *
+     * \return The child that finished, with its exit code and
+     * resource usage in getStats().  The pid of the child is -1 if
+     * the group is empty or the timeout expired.
+     */
+    ChildProcess waitAny(int timeout = -1);
+
+    /** Returns the number of children yet to be reaped. */
+    size_t size() const { return running.size() + finished.size(); }
+
+    /** Returns true if there are no children yet to be reaped. */
+    bool empty() const { return size() == 0; }
+
+    /** The epoll descriptor that is readable when a child in the group
+        has finished (for use in an event loop).  Call waitAny(0)
+        once it is readable. */
+    int fd() const { return epollFd; }
+
+private:
+    /** Waits (for up to timeout milliseconds) for children to
+        finish and moves the ones that have finished to the finished
+        queue. */
+    void reap(int timeout);
+
+    /** The epoll instance watching the pidfds (or the signalfd). */
+    int epollFd = -1;
+
+    /** The signalfd for SIGCHLD.  -1 if pidfds are used. */
+    int sigFd = -1;
+
+    /** The signal mask before SIGCHLD was blocked (with signalfd). */
+    sigset_t oldMask;
+
+    /** The running children indexed by pid, along with their pidfd
+        (-1 with signalfd). */
+    std::unordered_map<int, std::pair<ChildProcess, int>> running;
+
+    /** Children that have been reaped but not yet returned. */
+    std::deque<ChildProcess> finished;
+};
+
+#endif
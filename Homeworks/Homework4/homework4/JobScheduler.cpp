@@ -0,0 +1,466 @@
+#ifndef JOB_SCHEDULER_CPP
+#define JOB_SCHEDULER_CPP
+
+/**
+ * Implementation of the class to run a DAG of jobs.
+ *
+ * File:   JobScheduler.cpp
+ * Author: Kyle Lierer
+ *
+ * Copyright (C) 2020 liererkt@miamioh.edu
+ */
+
+#include <poll.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <boost/format.hpp>
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include "JobScheduler.h"
+
+/**
+ * Helper method to check if a word is a label, i.e., a name (made of
+ * letters, digits, '_', '-', or '.') followed by a ':'.
+ *
+ * \param[in] word The word to be checked.
+ *
+ * \return True if the word is a label.
+ */
+static bool isLabel(const std::string& word) {
+    return word.size() > 1 && word.back() == ':' &&
+        std::all_of(word.begin(), word.end() - 1, [](char c) {
+            return std::isalnum(c) || c == '_' || c == '-' || c == '.';
+        });
+}
+
+/**
+ * Helper method to convert the time between two points to seconds.
+ *
+ * \param[in] from The earlier time.
+ *
+ * \param[in] to The later time.
+ *
+ * \return The time in seconds.
+ */
+static double seconds(std::chrono::steady_clock::time_point from,
+                      std::chrono::steady_clock::time_point to) {
+    return std::chrono::duration<double>(to - from).count();
+}
+
+JobScheduler::JobScheduler(size_t maxJobs, bool showStats, std::ostream& os,
+                           ResultCache* cache)
+    : maxJobs(std::max<size_t>(1, maxJobs)), showStats(showStats), os(os),
+      cache(cache), startTime(Clock::now()) {
+    // Instance variables are initialized and not assigned!
+}
+
+std::string
+JobScheduler::parse(const std::string& line, Job& job) const {
+    std::istringstream is(line);
+    size_t cmdPos = 0;
+    for (std::string word; is >> word;) {
+        if (word.compare(0, 6, "after:") == 0 && word.size() > 6) {
+            // A comma-separated list of labels of earlier jobs.
+            std::istringstream list(word.substr(6));
+            for (std::string label; std::getline(list, label, ',');) {
+                const auto entry = labels.find(label);
+                if (entry == labels.end()) {
+                    throw std::invalid_argument("Unknown label '" + label +
+                                                "' in: " + line);
+                }
+                job.deps.push_back(entry->second);
+            }
+        } else if (word.compare(0, 3, "in:") == 0 && word.size() > 3) {
+            // A comma-separated list of input files.
+            std::istringstream list(word.substr(3));
+            for (std::string input; std::getline(list, input, ',');) {
+                job.inputs.push_back(input);
+            }
+            job.cacheable = true;
+        } else if (word == "cache:") {
+            job.cacheable = true;  // A pure job without input files.
+        } else if (cmdPos == 0 && isLabel(word)) {
+            job.label = word.substr(0, word.size() - 1);
+            if (labels.find(job.label) != labels.end()) {
+                throw std::invalid_argument("Duplicate label '" + job.label +
+                                            "' in: " + line);
+            }
+        } else {
+            break;  // The start of the command.
+        }
+        cmdPos = (is.eof() ? line.size() : size_t(is.tellg()));
+    }
+    return line.substr(cmdPos);
+}
+
+void
+JobScheduler::add(const std::string& line) {
+    Job job;
+    try {
+        job.pipeline = Pipeline(parse(line, job));
+        if (job.pipeline.empty() && (!job.label.empty() ||
+                                     !job.deps.empty())) {
+            throw std::invalid_argument("Missing command in: " + line);
+        }
+    } catch (const std::invalid_argument& e) {
+        os << e.what() << std::endl;
+        return;
+    }
+    if (job.pipeline.empty()) {
+        return;  // Blank line or a comment.
+    }
+    const size_t id = jobs.size();
+    if (!job.label.empty()) {
+        labels[job.label] = id;
+    }
+    // Count the dependencies that have not finished yet.
+    bool skip = false;
+    for (size_t dep : job.deps) {
+        jobs[dep].dependents.push_back(id);
+        if (jobs[dep].state == State::Skipped ||
+            (jobs[dep].state == State::Done && jobs[dep].status != 0)) {
+            skip = true;
+        } else if (jobs[dep].state != State::Done) {
+            job.waitingFor++;
+        }
+    }
+    dependencies = dependencies || !job.deps.empty();
+    jobs.push_back(std::move(job));
+    // The chains through the dependencies now include this job.
+    for (size_t dep : jobs[id].deps) {
+        raiseLevel(dep, 2);
+    }
+    if (skip) {
+        finishJob(id, State::Skipped);
+    } else if (jobs[id].waitingFor == 0) {
+        setReady(id);
+    }
+    // Reap jobs that have finished (without waiting) to free slots.
+    while (!group.empty() && reapNext(0)) {}
+    startReady();
+}
+
+void
+JobScheduler::setReady(size_t id) {
+    Job& job   = jobs[id];
+    job.state   = State::Ready;
+    job.readyAt = Clock::now();
+    ready.insert({-static_cast<long>(job.level), id});
+}
+
+void
+JobScheduler::raiseLevel(size_t id, size_t level) {
+    // An explicit stack is used as chains can be very long.
+    std::vector<std::pair<size_t, size_t>> stack = {{id, level}};
+    while (!stack.empty()) {
+        const size_t curr = stack.back().first, lvl = stack.back().second;
+        stack.pop_back();
+        Job& job = jobs[curr];
+        // Jobs that have started no longer need a priority.  Their
+        // dependencies have also finished.
+        if (job.level >= lvl || (job.state != State::Waiting &&
+                                 job.state != State::Ready)) {
+            continue;
+        }
+        if (job.state == State::Ready) {
+            ready.erase({-static_cast<long>(job.level), curr});
+            ready.insert({-static_cast<long>(lvl), curr});
+        }
+        job.level = lvl;
+        for (size_t dep : job.deps) {
+            stack.push_back({dep, lvl + 1});
+        }
+    }
+}
+
+void
+JobScheduler::startReady() {
+    while (running < maxJobs && !ready.empty()) {
+        const size_t id = ready.begin()->second;
+        ready.erase(ready.begin());
+        Job& job = jobs[id];
+        // When grouped, the output is collected in block first.
+        std::ostringstream block;
+        std::ostream& out = (mux ? block : os);
+        if (mux) {
+            mux->start(id, tagOf(id));
+        }
+        out << "Running: " << job.pipeline.toString() << std::endl;
+        job.state = State::Running;
+        job.start = Clock::now();
+        running++;
+        // Builtins that block (e.g., sleep) are only run in-process if
+        // the jobs run one at a time anyway.
+        const std::vector<StrVec>& cmds = job.pipeline.getCommands();
+        int outFd = -1;
+        if (cmds.size() == 1 &&
+            Builtins::run(cmds[0], out, maxJobs == 1, job.status)) {
+            job.builtin = true;
+        } else if (cache != nullptr && job.cacheable &&
+                   checkCache(job, out, outFd)) {
+            // Replayed from the cache.
+        } else if (mux && outFd == -1) {
+            outFd = mux->capture(id);
+        }
+        if (mux) {
+            mux->append(id, block.str());
+        }
+        if (job.builtin || job.cached) {
+            finishJob(id, State::Done);
+            continue;
+        }
+        // The output goes to the cache file or the mux, if any.
+        job.pipeline.start(outFd);
+        if (outFd != -1) {
+            close(outFd);
+        }
+        for (const ChildProcess& stage : job.pipeline.getStages()) {
+            if (stage.getPid() <= 0) {
+                continue;  // The stage could not be started.
+            } else if (group.add(stage)) {
+                jobOf[stage.getPid()] = id;
+            } else {
+                // Cannot be watched (e.g., out of descriptors).
+                ChildProcess child = stage;
+                child.wait();
+                job.pipeline.setFinished(child);
+            }
+        }
+        if (job.pipeline.isDone()) {
+            finishJob(id, State::Done);
+        }
+    }
+}
+
+bool
+JobScheduler::checkCache(Job& job, std::ostream& out, int& outFd) {
+    job.cacheKey = cache->getKey(job.pipeline.getCommands(), job.inputs);
+    if (job.cacheKey.empty()) {
+        return false;  // An input file is missing.
+    }
+    job.cached = cache->replay(job.cacheKey, out, job.status);
+    if (!job.cached && (outFd = cache->createTemp(job.outPath)) == -1) {
+        job.outPath.clear();
+    }
+    return job.cached;
+}
+
+void
+JobScheduler::saveOutput(Job& job, std::ostream& out) {
+    {
+        std::ifstream output(job.outPath, std::ios::binary);
+        // Writing an empty buffer would set the failbit of out.
+        if (output.peek() != EOF) {
+            out << output.rdbuf();
+        }
+        out << std::flush;
+    }
+    // Only commands that ran to completion (all of their stages
+    // started and exited normally) are cached.
+    const std::vector<ChildProcess>& stages = job.pipeline.getStages();
+    const bool complete = std::all_of(stages.begin(), stages.end(),
+                                      [](const ChildProcess& c) {
+        return c.getPid() > 0 && WIFEXITED(c.getStats().status);
+    });
+    if (complete) {
+        cache->store(job.cacheKey, job.outPath, job.status);
+    } else {
+        unlink(job.outPath.c_str());
+    }
+}
+
+bool
+JobScheduler::reapNext(int timeout) {
+    ChildProcess child = group.waitAny(mux ? 0 : timeout);
+    if (mux) {
+        // The output of the jobs is collected while waiting for a
+        // child, so that the children do not block on full pipes.
+        while (child.getPid() == -1 && !group.empty()) {
+            mux->poll({group.fd()}, timeout);
+            child = group.waitAny(0);
+            if (timeout != -1) {
+                break;
+            }
+        }
+    }
+    if (child.getPid() == -1) {
+        return false;
+    }
+    const auto entry = jobOf.find(child.getPid());
+    if (entry != jobOf.end()) {
+        const size_t id = entry->second;
+        jobOf.erase(entry);
+        jobs[id].pipeline.setFinished(child);
+        if (jobs[id].pipeline.isDone()) {
+            finishJob(id, State::Done);
+        }
+    }
+    return true;
+}
+
+void
+JobScheduler::finishJob(size_t id, State state) {
+    Job& job = jobs[id];
+    if (job.state == State::Running) {
+        running--;
+    }
+    job.state  = state;
+    job.finish = Clock::now();
+    // When grouped, the output is collected in block first.
+    std::ostringstream block;
+    std::ostream& out = (mux ? block : os);
+    if (state == State::Skipped) {
+        if (mux) {
+            mux->start(id, tagOf(id));
+        }
+        out << "Skipped: " << job.pipeline.toString()
+            << " (a dependency failed)" << std::endl;
+    } else if (!job.cached && !job.builtin) {
+        job.status = job.pipeline.exitStatus();
+        if (!job.outPath.empty()) {
+            saveOutput(job, out);
+        }
+    }
+    // A command that could not be started reports 127 (as in a
+    // shell), whether it is a single command or a pipeline stage.
+    if (state == State::Done) {
+        printExitInfo(job, out);
+    }
+    if (mux) {
+        mux->finish(id, block.str());
+    }
+    const bool failed = (state == State::Skipped || job.status != 0);
+    for (size_t dep : job.dependents) {
+        if (jobs[dep].state != State::Waiting) {
+            continue;  // Already skipped because of another dependency
+        } else if (failed) {
+            finishJob(dep, State::Skipped);
+        } else if (--jobs[dep].waitingFor == 0) {
+            setReady(dep);
+        }
+    }
+}
+
+void
+JobScheduler::wait() {
+    startReady();
+    while (running > 0) {
+        reapNext(-1);
+        startReady();
+    }
+}
+
+std::string
+JobScheduler::tagOf(size_t id) const {
+    return "[" + (jobs[id].label.empty() ? std::to_string(id + 1) :
+                  jobs[id].label) + "] ";
+}
+
+void
+JobScheduler::groupOutput(OutputMux::Order order, bool prefix) {
+    mux = std::make_unique<OutputMux>(os, order, prefix);
+}
+
+void
+JobScheduler::waitFor(int fd) {
+    startReady();
+    pollfd fds[2] = {{fd, POLLIN, 0}, {group.fd(), POLLIN, 0}};
+    while (::poll(fds, 1, 0) == 0) {
+        // Wait for fd, a child, or (if grouped) output from the jobs.
+        if (mux) {
+            mux->poll({fd, group.fd()}, -1);
+        } else {
+            ::poll(fds, (group.empty() ? 1 : 2), -1);
+        }
+        while (!group.empty() && reapNext(0)) {}
+        startReady();
+    }
+}
+
+void
+JobScheduler::printExitInfo(const Job& entry, std::ostream& out) const {
+    // Replayed and builtin jobs have no child processes.
+    if (entry.cached || entry.builtin) {
+        out << "Exit code: " << entry.status
+           << (entry.cached ? " (cached)" : "") << std::endl;
+        return;
+    }
+    // The exit code of a pipeline is that of the last stage.  The
+    // exit codes of the other stages are also printed.
+    const Pipeline& job = entry.pipeline;
+    const std::vector<ChildProcess>& stages = job.getStages();
+    out << "Exit code: " << job.exitStatus();
+    if (stages.size() > 1) {
+        for (size_t i = 0; (i < stages.size()); i++) {
+            out << (i == 0 ? " (stages: " : " | ") << job.exitStatus(i);
+        }
+        out << ')';
+    }
+    out << std::endl;
+    if (!showStats) {
+        return;
+    }
+    for (size_t i = 0; (i < stages.size()); i++) {
+        if (stages[i].getPid() <= 0) {
+            continue;  // The stage could not be started.
+        }
+        const ChildStats& stats = stages[i].getStats();
+        const std::string label = (stages.size() > 1 ? " (" +
+                                   job.getCommands()[i][0] + ")" : "");
+        out << boost::format("Stats%s: wall %.3fs, user %.3fs, sys %.3fs, "
+                            "max RSS %d KB, spawn %.0f us, "
+                            "context switches %d/%d\n")
+            % label % stats.wallSec % stats.userSec % stats.sysSec
+            % stats.maxRssKb % stats.spawnUsec % stats.volCtxSw
+            % stats.involCtxSw;
+    }
+}
+
+void
+JobScheduler::printReport() const {
+    // Find the job that finished last.
+    size_t last = jobs.size();
+    for (size_t i = 0; (i < jobs.size()); i++) {
+        if (jobs[i].state == State::Done &&
+            (last == jobs.size() || jobs[i].finish > jobs[last].finish)) {
+            last = i;
+        }
+    }
+    const double total = (last == jobs.size() ? 0 :
+                          seconds(startTime, jobs[last].finish));
+    os << boost::format("Jobs: %d, at most %d at a time, total wall time "
+                        "%.3fs\n") % jobs.size() % maxJobs % total;
+    if (last == jobs.size()) {
+        return;
+    }
+    // Walk back along the dependencies that finished last.
+    std::vector<size_t> path = {last};
+    while (!jobs[path.back()].deps.empty()) {
+        const auto& deps = jobs[path.back()].deps;
+        path.push_back(*std::max_element(deps.begin(), deps.end(),
+                                         [this](size_t a, size_t b) {
+            return jobs[a].finish < jobs[b].finish;
+        }));
+    }
+    double run = 0, wait = 0;
+    for (size_t id : path) {
+        run  += seconds(jobs[id].start, jobs[id].finish);
+        wait += seconds(jobs[id].readyAt, jobs[id].start);
+    }
+    os << boost::format("Critical path: %d jobs, %.3fs running, %.3fs "
+                        "waiting for a free slot\n") % path.size() % run %
+        wait;
+    for (auto id = path.rbegin(); id != path.rend(); id++) {
+        const Job& job = jobs[*id];
+        os << boost::format("  %8.3fs - %8.3fs  %s%s\n") %
+            seconds(startTime, job.start) % seconds(startTime, job.finish) %
+            (job.label.empty() ? "" : job.label + ": ") %
+            job.pipeline.toString();
+    }
+}
+
+#endif
@@ -0,0 +1,263 @@
+#ifndef JOB_SCHEDULER_H
+#define JOB_SCHEDULER_H
+
+/**
+ * A class to run the commands of a script as jobs, with at most a
+ * given number of jobs running at the same time, honoring the
+ * dependencies declared between the commands.
+ *
+ * File:   JobScheduler.h
+ * Author: Kyle Lierer
+ *
+ * Copyright (C) 2020 liererkt@miamioh.edu
+ */
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "Builtins.h"
+#include "ChildProcessGroup.h"
+#include "OutputMux.h"
+#include "Pipeline.h"
+#include "ResultCache.h"
+
+/**
+ * Runs a directed acyclic graph (DAG) of jobs.  Each line of a script
+ * is a job (a Pipeline), optionally preceded by a label and a list of
+ * the labels of the jobs it must run after:
+ *
+ *     fetch: curl -sO http://example.com/data.txt
+ *     count: after:fetch wc -l data.txt
+ *     after:fetch,count rm data.txt
+ *     in:data.txt sort data.txt
+ *     cache: uname -a
+ *
+ * A label is a first word that ends with ':' and consists of letters,
+ * digits, '_', '-', or '.'.  Dependencies can only refer to labels of
+ * earlier lines, so the order of the script is always a valid
+ * (serial) order.  A job whose dependency fails (exits with a
+ * non-zero code) is skipped, as are the jobs that depend on it.
+ * The "in:" word lists the files the output of a job depends on, for
+ * use with a ResultCache.  The "cache:" word marks a job without
+ * input files as cacheable ("cache" is hence not a valid label).
+ *
+ * Jobs whose dependencies have finished are started as soon as fewer
+ * than the maximum number of jobs are running.  When several jobs are
+ * ready, the one with the longest chain of jobs depending on it
+ * (i.e., on the critical path) is started first, breaking ties in
+ * script order.  With unit cost per job this is Hu's level
+ * scheduling, which keeps the makespan close to optimal.
+ *
+ * Jobs that are a single builtin command (see Builtins) are run
+ * in-process, without forking.  With a ResultCache, the output of
+ * each job marked with "in:" or "cache:" is captured to a file and
+ * printed when the job finishes.  Such jobs found in the cache are not
+ * run at all: their output and exit code are replayed.  Hence only
+ * pure jobs (whose output depends only on their command line and
+ * inputs, and which have no side effects) may be marked.  Other jobs
+ * always run.
+ *
+ * By default the children write directly to the shell's standard
+ * output.  With groupOutput, all the output of a job (including the
+ * lines printed by the scheduler) is printed as one block.
+ */
+class JobScheduler {
+public:
+    /** Creates an empty scheduler.
+
+        \param[in] maxJobs The maximum number of jobs that run at the
+        same time.  With 1, jobs run one after another in script
+        order.
+
+        \param[in] showStats If true, the resources used by each job
+        are printed along with its exit code.
+
+        \param[in] os The stream to where the progress is printed.
+
+        \param[in] cache The cache for the results of the jobs.  If
+        null, the results are not cached.
+    */
+    explicit JobScheduler(size_t maxJobs = 1, bool showStats = false,
+                          std::ostream& os = std::cout,
+                          ResultCache* cache = nullptr);
+
+    /**
+     * Adds the command on a line of a script as a job.  The job is
+     * started right away if its dependencies have finished and fewer
+     * than maxJobs jobs are running.  This method does not block, but
+     * reaps jobs that have finished (starting waiting jobs).  Errors
+     * in the line are printed and the line is ignored.
+     *
+     * \param[in] line The line from the script.  Blank lines and
+     * comments are ignored.
+     */
+    void add(const std::string& line);
+
+    /** Runs all the jobs that have been added and waits for them to
+        finish. */
+    void wait();
+
+    /**
+     * Groups the output of each job into one block (see OutputMux)
+     * so that the output of jobs running in parallel is not
+     * interleaved.  Call it before adding jobs.
+     *
+     * \param[in] order The order in which the blocks are printed.
+     *
+     * \param[in] prefix If true, each line of a job is prefixed with
+     * its label (or its number in the script), e.g., "[build] ".
+     */
+    void groupOutput(OutputMux::Order order, bool prefix);
+
+    /**
+     * Runs the jobs (reaping the ones that finish and starting the
+     * ones that become ready) until a descriptor is readable, e.g.,
+     * while waiting for more of the script.
+     *
+     * \param[in] fd The descriptor to wait for.
+     */
+    void waitFor(int fd);
+
+    /** Returns true if any of the jobs declared dependencies. */
+    bool hasDependencies() const { return dependencies; }
+
+    /**
+     * Prints the number of jobs, the total wall time, and the
+     * critical path: starting from the job that finished last, the
+     * chain of jobs each of which was waiting for the dependency that
+     * finished last.  The report shows whether the total time was
+     * spent on dependencies or waiting for a free slot.
+     */
+    void printReport() const;
+
+private:
+    /** Shortcut to the clock used to time the jobs. */
+    using Clock = std::chrono::steady_clock;
+
+    /** The states of a job. */
+    enum class State { Waiting, Ready, Running, Done, Skipped };
+
+    /** A command in the script along with its dependencies. */
+    struct Job {
+        /** The optional label of the job ("" if none). */
+        std::string label;
+        /** The command to be run. */
+        Pipeline pipeline;
+        /** The jobs this job runs after. */
+        std::vector<size_t> deps;
+        /** The jobs that run after this job. */
+        std::vector<size_t> dependents;
+        /** The input files of the job (for the cache). */
+        StrVec inputs;
+        /** True if the job may be replayed from the cache (it is
+            marked with "in:" or "cache:"). */
+        bool cacheable = false;
+        /** The key in the cache ("" if not cacheable) and the file
+            to which the output is captured ("" if none). */
+        std::string cacheKey, outPath;
+        /** True if the result was replayed from the cache. */
+        bool cached = false;
+        /** True if the job was run in-process (see Builtins). */
+        bool builtin = false;
+        /** The exit status, once the job is done. */
+        int status = 0;
+        /** The number of dependencies yet to finish. */
+        size_t waitingFor = 0;
+        /** The number of jobs in the longest chain starting with this
+            job (its priority). */
+        size_t level = 1;
+        /** The state of the job. */
+        State state = State::Waiting;
+        /** The times at which the job became ready to run, was
+            started, and finished. */
+        Clock::time_point readyAt, start, finish;
+    };
+
+    /** The key used to order ready jobs: the negated level (so that
+        higher levels come first) and the index of the job. */
+    using ReadyKey = std::pair<long, size_t>;
+
+    /** Parses the label and the dependencies at the start of a line
+        into the job.  Returns the rest of the line (the command). */
+    std::string parse(const std::string& line, Job& job) const;
+
+    /** Marks the job as ready to run. */
+    void setReady(size_t id);
+
+    /** Raises the levels of the given job and of the jobs it depends
+        on (if needed) to account for a chain of the given length. */
+    void raiseLevel(size_t id, size_t level);
+
+    /** Starts ready jobs (highest level first) while there are free
+        slots. */
+    void startReady();
+
+    /** Waits for (up to timeout milliseconds) and reaps the next
+        child process to finish.  Returns false on timeout. */
+    bool reapNext(int timeout);
+
+    /** Records that a job has finished (or was skipped) and releases
+        or skips the jobs that depend on it. */
+    void finishJob(size_t id, State state);
+
+    /** Replays the job from the cache (to out) if possible.
+        Otherwise creates the file to capture its output (outFd).
+        Returns true on a hit. */
+    bool checkCache(Job& job, std::ostream& out, int& outFd);
+
+    /** Prints the captured output of a finished job (to out) and
+        stores it in the cache (if the job ran to completion). */
+    void saveOutput(Job& job, std::ostream& out);
+
+    /** Returns the tag of a job for grouped output, e.g., "[3] ". */
+    std::string tagOf(size_t id) const;
+
+    /** Prints the exit code (and the statistics) of a finished job. */
+    void printExitInfo(const Job& job, std::ostream& out) const;
+
+    /** The maximum number of jobs running at the same time. */
+    const size_t maxJobs;
+
+    /** Whether the resources used by each job are printed. */
+    const bool showStats;
+
+    /** The stream to where the progress is printed. */
+    std::ostream& os;
+
+    /** All the jobs, in script order. */
+    std::vector<Job> jobs;
+
+    /** The index of the job with each label. */
+    std::unordered_map<std::string, size_t> labels;
+
+    /** The jobs that are ready to run, highest level first. */
+    std::set<ReadyKey> ready;
+
+    /** The cache for the results of the jobs (if any). */
+    ResultCache* const cache;
+
+    /** The output of the jobs, if grouped (see groupOutput). */
+    std::unique_ptr<OutputMux> mux;
+
+    /** The running child processes. */
+    ChildProcessGroup group;
+
+    /** The job that each running child process belongs to. */
+    std::unordered_map<int, size_t> jobOf;
+
+    /** The number of jobs running. */
+    size_t running = 0;
+
+    /** Whether any job declared dependencies. */
+    bool dependencies = false;
+
+    /** The time at which the scheduler was created. */
+    const Clock::time_point startTime;
+};
+
+#endif
@@ -0,0 +1,201 @@
+#ifndef OUTPUT_MUX_CPP
+#define OUTPUT_MUX_CPP
+
+/**
+ * Implementation of the class to group the output of parallel jobs.
+ *
+ * File:   OutputMux.cpp
+ * Author: Kyle Lierer
+ *
+ * Copyright (C) 2020 liererkt@miamioh.edu
+ */
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "OutputMux.h"
+
+/** The size of the blocks in which output is read. */
+static const size_t BlockSize = 65536;
+
+OutputMux::OutputMux(std::ostream& os, Order order, bool prefix,
+                     size_t spillBytes) : os(os), order(order),
+                                          prefix(prefix),
+                                          spillBytes(spillBytes) {
+    // Instance variables are initialized and not assigned!
+}
+
+OutputMux::~OutputMux() {
+    for (auto& entry : jobs) {
+        if (entry.second.pipeFd != -1) {
+            close(entry.second.pipeFd);
+        }
+        if (entry.second.spillFd != -1) {
+            close(entry.second.spillFd);
+        }
+    }
+}
+
+void
+OutputMux::start(size_t id, const std::string& tag) {
+    jobs[id].tag = tag;
+    if (order == Order::Start) {
+        started.push_back(id);
+    }
+}
+
+int
+OutputMux::capture(size_t id) {
+    int pipeFds[2];
+    if (pipe2(pipeFds, O_CLOEXEC) == -1) {
+        std::cerr << "Call to pipe2 failed: " << std::strerror(errno)
+                  << std::endl;
+        return -1;
+    }
+    // The read-end is drained without blocking in poll and finish.
+    fcntl(pipeFds[0], F_SETFL, O_NONBLOCK);
+    jobs[id].pipeFd = pipeFds[0];
+    return pipeFds[1];
+}
+
+void
+OutputMux::append(size_t id, const std::string& data) {
+    add(jobs[id], data.data(), data.size());
+}
+
+void
+OutputMux::add(Output& out, const char* data, size_t len) {
+    if (!prefix) {
+        out.buffer.append(data, len);
+    } else {
+        // Insert the tag at the start of each line.
+        for (const char *end = data + len; data < end;) {
+            if (out.lineStart) {
+                out.buffer += out.tag;
+            }
+            const char *eol = static_cast<const char*>(
+                std::memchr(data, '\n', end - data));
+            const char *next = (eol == nullptr ? end : eol + 1);
+            out.buffer.append(data, next - data);
+            out.lineStart = (eol != nullptr);
+            data = next;
+        }
+    }
+    if (out.buffer.size() <= spillBytes) {
+        return;
+    }
+    // Move the output to a temporary file.  The file is unlinked right
+    // away, so it is removed when it is closed (even on crashes).
+    if (out.spillFd == -1) {
+        const char *tmpDir = std::getenv("TMPDIR");
+        std::string path = std::string(tmpDir ? tmpDir : "/tmp") +
+            "/hw4_outXXXXXX";
+        if ((out.spillFd = mkostemp(&path[0], O_CLOEXEC)) == -1) {
+            return;  // Keep the output in memory.
+        }
+        unlink(path.c_str());
+    }
+    for (size_t done = 0; done < out.buffer.size();) {
+        const ssize_t n = write(out.spillFd, out.buffer.data() + done,
+                                out.buffer.size() - done);
+        if (n == -1 && errno != EINTR) {
+            out.buffer.erase(0, done);
+            return;  // Keep the rest in memory (e.g., the disk is full)
+        }
+        done += std::max<ssize_t>(n, 0);
+    }
+    out.buffer.clear();
+}
+
+bool
+OutputMux::drain(Output& out) {
+    char buf[BlockSize];
+    while (true) {
+        const ssize_t n = read(out.pipeFd, buf, sizeof(buf));
+        if (n > 0) {
+            add(out, buf, n);
+        } else if (n == -1 && errno == EINTR) {
+            continue;
+        } else if (n == -1 && errno == EAGAIN) {
+            return true;  // No more output for now
+        } else {
+            close(out.pipeFd);  // End of the output (or an error)
+            out.pipeFd = -1;
+            return false;
+        }
+    }
+}
+
+void
+OutputMux::poll(const std::vector<int>& others, int timeout) {
+    // The other descriptors followed by the pipes of the jobs.
+    std::vector<pollfd> fds;
+    for (int fd : others) {
+        fds.push_back({fd, POLLIN, 0});
+    }
+    std::vector<Output*> outs;
+    for (auto& entry : jobs) {
+        if (entry.second.pipeFd != -1) {
+            fds.push_back({entry.second.pipeFd, POLLIN, 0});
+            outs.push_back(&entry.second);
+        }
+    }
+    if (::poll(fds.data(), fds.size(), timeout) <= 0) {
+        return;  // Timeout (or a signal)
+    }
+    for (size_t i = 0; (i < outs.size()); i++) {
+        if (fds[i + others.size()].revents != 0) {
+            drain(*outs[i]);
+        }
+    }
+}
+
+void
+OutputMux::finish(size_t id, const std::string& last) {
+    Output& out = jobs[id];
+    out.done = true;
+    // The children have exited, so their output is in the pipe.  A
+    // background grandchild may still have the pipe open.  Its
+    // later output is discarded rather than waiting for it.
+    if (out.pipeFd != -1 && drain(out)) {
+        close(out.pipeFd);
+        out.pipeFd = -1;
+    }
+    add(out, last.data(), last.size());
+    if (order == Order::Completion) {
+        print(out);
+        jobs.erase(id);
+        return;
+    }
+    while (!started.empty() && jobs[started.front()].done) {
+        print(jobs[started.front()]);
+        jobs.erase(started.front());
+        started.pop_front();
+    }
+}
+
+void
+OutputMux::print(Output& out) {
+    if (out.spillFd != -1) {
+        char buf[BlockSize];
+        lseek(out.spillFd, 0, SEEK_SET);
+        for (ssize_t n; (n = read(out.spillFd, buf, sizeof(buf))) > 0;) {
+            os.write(buf, n);
+        }
+        close(out.spillFd);
+        out.spillFd = -1;
+    }
+    os << out.buffer;
+    // The next job starts on a new line.
+    if (prefix && !out.lineStart) {
+        os << '\n';
+    }
+    os << std::flush;
+}
+
+#endif
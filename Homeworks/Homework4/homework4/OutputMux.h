@@ -0,0 +1,155 @@
+#ifndef OUTPUT_MUX_H
+#define OUTPUT_MUX_H
+
+/**
+ * A class to collect the output of jobs that run in parallel and to
+ * print the output of each job as one block, so that the output of
+ * different jobs is never interleaved.
+ *
+ * File:   OutputMux.h
+ * Author: Kyle Lierer
+ *
+ * Copyright (C) 2020 liererkt@miamioh.edu
+ */
+
+#include <deque>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Buffers the output of each job until the job finishes.  The
+ * standard output of a job's children is captured via a pipe, which
+ * is drained (see poll) while the jobs run, so that children never
+ * block on a full pipe.  The output of a job is kept in memory and
+ * spills to an (unlinked) temporary file once it exceeds a
+ * threshold.  Finished jobs are printed either as soon as they finish
+ * (completion order) or in the order in which they were started
+ * (start order, which matches the output of running the jobs one at
+ * a time).
+ */
+class OutputMux {
+public:
+    /** The orders in which the output of jobs can be printed. */
+    enum class Order { Completion, Start };
+
+    /**
+     * Creates a multiplexer with no jobs.
+     *
+     * \param[out] os The stream to where the output is printed.
+     *
+     * \param[in] order The order in which jobs are printed.
+     *
+     * \param[in] prefix If true, each line of output is prefixed with
+     * the tag of its job (e.g., "[3] ").
+     *
+     * \param[in] spillBytes The size above which the output of a job
+     * is moved to a temporary file.
+     */
+    OutputMux(std::ostream& os, Order order, bool prefix,
+              size_t spillBytes = 1 << 20);
+
+    /** Closes the pipes and temporary files of unfinished jobs. */
+    ~OutputMux();
+
+    // The multiplexer owns file descriptors and cannot be copied.
+    OutputMux(const OutputMux&) = delete;
+    OutputMux& operator=(const OutputMux&) = delete;
+
+    /**
+     * Adds a job that is being started.
+     *
+     * \param[in] id The unique identifier of the job.
+     *
+     * \param[in] tag The tag used to prefix the lines of the job.
+     */
+    void start(size_t id, const std::string& tag);
+
+    /**
+     * Creates a pipe to capture the output of a job.
+     *
+     * \param[in] id The job (see start).
+     *
+     * \return The write-end of the pipe (close-on-exec) to be used as
+     * the standard output of the children.  The caller closes it once
+     * the children are started.  -1 on errors (the children then
+     * write directly to the shell's output).
+     */
+    int capture(size_t id);
+
+    /**
+     * Adds output (e.g., from the shell) to a job.
+     *
+     * \param[in] id The job (see start).
+     *
+     * \param[in] data The output to be added.
+     */
+    void append(size_t id, const std::string& data);
+
+    /**
+     * Waits for (up to timeout milliseconds) output from the jobs or
+     * until one of the other descriptors is readable and collects the
+     * output that is available.
+     *
+     * \param[in] others Other descriptors to wait for (e.g., that of
+     * a ChildProcessGroup).
+     *
+     * \param[in] timeout The maximum time to wait.  -1 waits until
+     * one of the others is readable.
+     */
+    void poll(const std::vector<int>& others, int timeout);
+
+    /**
+     * Marks a job as finished, collecting the rest of its output, and
+     * prints the jobs that can be printed.
+     *
+     * \param[in] id The job (see start).
+     *
+     * \param[in] last Output (e.g., from the shell) to be added after
+     * the rest of the output of the job.
+     */
+    void finish(size_t id, const std::string& last = "");
+
+private:
+    /** The output of a job. */
+    struct Output {
+        std::string tag;        ///< Prefix for each line
+        std::string buffer;     ///< Output not yet spilled
+        int pipeFd  = -1;       ///< Read-end of the capture pipe
+        int spillFd = -1;       ///< Temporary file with earlier output
+        bool lineStart = true;  ///< If the next byte starts a line
+        bool done = false;      ///< If the job has finished
+    };
+
+    /** Adds output to a job, inserting prefixes and spilling to a
+        temporary file if needed. */
+    void add(Output& out, const char* data, size_t len);
+
+    /** Reads the output available on the pipe of a job.  Returns
+        false once the pipe is closed (or on errors). */
+    bool drain(Output& out);
+
+    /** Prints the output of a job and releases its resources. */
+    void print(Output& out);
+
+    /** The stream to where the output is printed. */
+    std::ostream& os;
+
+    /** The order in which jobs are printed. */
+    const Order order;
+
+    /** Whether lines are prefixed with the tags of their jobs. */
+    const bool prefix;
+
+    /** The size above which output is moved to a temporary file. */
+    const size_t spillBytes;
+
+    /** The output of the jobs that have not been printed. */
+    std::unordered_map<size_t, Output> jobs;
+
+    /** The jobs not yet printed, in the order they were started. */
+    std::deque<size_t> started;
+};
+
+#endif
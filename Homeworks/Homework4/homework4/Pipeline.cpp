@@ -0,0 +1,139 @@
+#ifndef PIPELINE_CPP
+#define PIPELINE_CPP
+
+/**
+ * Implementation of the class to run pipelines of commands.
+ *
+ * File:   Pipeline.cpp
+ * Author: Kyle Lierer
+ *
+ * Copyright (C) 2020 liererkt@miamioh.edu
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include "Pipeline.h"
+
+Pipeline::Pipeline(const std::string& cmdLine) : commands(1) {
+    std::istringstream is(cmdLine);
+    while (is >> std::ws, !is.eof()) {
+        // A quoted word is used as is, even if it contains a '|'.
+        const bool quoted = (is.peek() == '"');
+        std::string word;
+        is >> std::quoted(word);
+        if (quoted) {
+            commands.back().push_back(word);
+            continue;
+        }
+        // Unquoted words may contain '|' between stages (e.g., "ls|wc")
+        size_t start = 0;
+        for (size_t bar; (bar = word.find('|', start)) != std::string::npos;
+             start = bar + 1) {
+            if (bar > start) {
+                commands.back().push_back(word.substr(start, bar - start));
+            }
+            commands.emplace_back();
+        }
+        if (start < word.size()) {
+            commands.back().push_back(word.substr(start));
+        }
+    }
+    // Blank lines and comments have nothing to run.
+    const StrVec& first = commands.front();
+    if ((commands.size() == 1 && first.empty()) ||
+        (!first.empty() && first.front() == "#")) {
+        commands.clear();
+        return;
+    }
+    for (const auto& cmd : commands) {
+        if (cmd.empty()) {
+            throw std::invalid_argument("Missing command in pipeline: " +
+                                        cmdLine);
+        }
+    }
+}
+
+int
+Pipeline::start(int outFd) {
+    stages.assign(commands.size(), ChildProcess());
+    reaped.assign(commands.size(), false);
+    running = 0;
+    // The read-end of the pipe from the previous stage.
+    int inFd = -1;
+    for (size_t i = 0; (i < commands.size()); i++) {
+        int pipeFds[2] = {-1, -1};
+        if (i + 1 < commands.size() && pipe2(pipeFds, O_CLOEXEC) == -1) {
+            std::cerr << "Call to pipe2 failed: " << std::strerror(errno)
+                      << std::endl;
+            break;
+        }
+        const int childFds[3] = {inFd, (i + 1 < commands.size() ?
+                                        pipeFds[1] : outFd), -1};
+        if (stages[i].forkNexec(commands[i], childFds) > 0) {
+            running++;
+        }
+        // The children have their own copies of the ends they use.
+        if (inFd != -1) {
+            close(inFd);
+        }
+        if (pipeFds[1] != -1) {
+            close(pipeFds[1]);
+        }
+        inFd = pipeFds[0];
+    }
+    if (inFd != -1) {
+        close(inFd);  // Only if a pipe could not be created.
+    }
+    return running;
+}
+
+bool
+Pipeline::setFinished(const ChildProcess& child) {
+    for (size_t i = 0; (i < stages.size()); i++) {
+        if (!reaped[i] && stages[i].getPid() == child.getPid()) {
+            stages[i] = child;
+            reaped[i] = true;
+            running--;
+            return true;
+        }
+    }
+    return false;
+}
+
+int
+Pipeline::wait() {
+    for (size_t i = 0; (i < stages.size()); i++) {
+        if (!reaped[i] && stages[i].getPid() > 0) {
+            stages[i].wait();
+            reaped[i] = true;
+            running--;
+        }
+    }
+    return exitStatus();
+}
+
+int
+Pipeline::exitStatus(size_t stage) const {
+    return (stages.at(stage).getPid() > 0 ?
+            stages[stage].getStats().status : NotStartedStatus);
+}
+
+std::string
+Pipeline::toString() const {
+    std::string line;
+    for (const auto& cmd : commands) {
+        line += (line.empty() ? "" : " |");
+        for (const auto& word : cmd) {
+            line += (line.empty() ? "" : " ") + word;
+        }
+    }
+    return line;
+}
+
+#endif
@@ -0,0 +1,123 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+/**
+ * A class to run a command line of the form "a | b | c" as a single
+ * job.  The standard output of each stage is connected directly to
+ * the standard input of the next one using a pipe, so that the data
+ * flows between the children without passing through the shell.
+ *
+ * File:   Pipeline.h
+ * Author: Kyle Lierer
+ *
+ * Copyright (C) 2020 liererkt@miamioh.edu
+ */
+
+#include <string>
+#include <vector>
+#include "ChildProcess.h"
+
+/**
+ * A pipeline of one or more commands.  A plain command (without any
+ * '|') is a pipeline with one stage.  Pipelines are copied like
+ * ChildProcess objects, i.e., copies refer to the same children.
+ */
+class Pipeline {
+public:
+    /** The exit status reported for a stage whose program could not
+        be executed (as for "command not found" in bash). */
+    static const int NotStartedStatus = 127 << 8;
+
+    /** Creates an empty pipeline (with no commands). */
+    Pipeline() = default;
+
+    /**
+     * Parses a command line into the commands of the pipeline.  The
+     * words are separated by blanks, honoring quotes (std::quoted).
+     * Stages are separated by an unquoted '|', with or without blanks
+     * around it.  A line that is blank or starts with the word "#"
+     * (a comment) results in an empty pipeline.
+     *
+     * \param[in] cmdLine The command line to be parsed.
+     *
+     * \exception std::invalid_argument If a stage has no command
+     * (e.g., "ls |").
+     */
+    explicit Pipeline(const std::string& cmdLine);
+
+    /** Returns true if the pipeline has no commands to run. */
+    bool empty() const { return commands.empty(); }
+
+    /** Returns the list of arguments of each stage. */
+    const std::vector<StrVec>& getCommands() const { return commands; }
+
+    /**
+     * Starts all the stages of the pipeline (using
+     * ChildProcess::forkNexec), connecting each stage to the next one
+     * with a pipe.  If a stage cannot be started, its neighbors see
+     * the end of the input or a closed pipe, as in a shell.
+     *
+     * \param[in] outFd If not -1, the descriptor to which the standard
+     * output of the last stage is redirected (e.g., a file).  The
+     * caller still owns (and closes) it.
+     *
+     * \return The number of stages that were started.
+     */
+    int start(int outFd = -1);
+
+    /** Returns the child process of each stage.  The pid of a stage
+        is -1 if it could not be started. */
+    const std::vector<ChildProcess>& getStages() const { return stages; }
+
+    /**
+     * Records that a stage has been reaped by someone else (e.g., by
+     * a ChildProcessGroup).
+     *
+     * \param[in] child The child (with its exit status) that was
+     * reaped.
+     *
+     * \return True if the child is a stage of this pipeline.
+     */
+    bool setFinished(const ChildProcess& child);
+
+    /** Returns true once all the stages that were started have been
+        reaped. */
+    bool isDone() const { return running == 0; }
+
+    /** Waits for all the stages to finish.
+
+        \return The exit status of the pipeline.
+    */
+    int wait();
+
+    /**
+     * Returns the exit status of a stage that has finished.
+     *
+     * \param[in] stage The index of the stage.
+     *
+     * \return The status from waitpid or NotStartedStatus.
+     */
+    int exitStatus(size_t stage) const;
+
+    /** Returns the exit status of the pipeline, i.e., that of the
+        last stage (as in a shell). */
+    int exitStatus() const { return exitStatus(stages.size() - 1); }
+
+    /** Returns the command line (e.g., "ls -l | wc -l"). */
+    std::string toString() const;
+
+private:
+    /** The list of arguments of each stage. */
+    std::vector<StrVec> commands;
+
+    /** The child process running each stage. */
+    std::vector<ChildProcess> stages;
+
+    /** Flags to indicate the stages that have been reaped. */
+    std::vector<bool> reaped;
+
+    /** The number of stages that are yet to be reaped. */
+    size_t running = 0;
+};
+
+#endif
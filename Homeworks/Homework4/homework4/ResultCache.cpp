@@ -0,0 +1,263 @@
+#ifndef RESULT_CACHE_CPP
+#define RESULT_CACHE_CPP
+
+/**
+ * Implementation of the class to cache the results of commands.
+ *
+ * File:   ResultCache.cpp
+ * Author: Kyle Lierer
+ *
+ * Copyright (C) 2020 liererkt@miamioh.edu
+ */
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <boost/format.hpp>
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include "ResultCache.h"
+
+// The list of environment variables (from unistd.h)
+extern char **environ;
+
+/**
+ * Helper method to return the size of a file.
+ *
+ * \param[in] path The path to the file.
+ *
+ * \return The size of the file in bytes, or 0 if it does not exist.
+ */
+static size_t fileSize(const std::string& path) {
+    struct stat info;
+    return (stat(path.c_str(), &info) == 0 ? info.st_size : 0);
+}
+
+/**
+ * Helper method to check if a string ends with a given suffix.
+ *
+ * \param[in] str The string to be checked.
+ *
+ * \param[in] suffix The suffix to look for.
+ *
+ * \return True if str ends with suffix.
+ */
+static bool endsWith(const std::string& str, const std::string& suffix) {
+    return str.size() >= suffix.size() &&
+        str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+ResultCache::ResultCache(const std::string& dir, size_t maxBytes)
+    : dir(dir), maxBytes(maxBytes) {
+    if (mkdir(dir.c_str(), 0755) == -1 && errno != EEXIST) {
+        throw std::invalid_argument("Cannot create cache directory " + dir +
+                                    ": " + std::strerror(errno));
+    }
+    // The environment is hashed in sorted order, as the order of the
+    // variables does not matter to the commands.
+    std::vector<std::string> env;
+    for (char **var = environ; *var != nullptr; var++) {
+        env.push_back(*var);
+    }
+    std::sort(env.begin(), env.end());
+    uint64_t envValue = hash("", 0);
+    for (const auto& var : env) {
+        envValue = hash(var.c_str(), var.size() + 1, envValue);
+    }
+    envHash = toHex(envValue);
+    // Account for the entries from earlier runs.
+    DIR *entries = opendir(dir.c_str());
+    if (entries == nullptr) {
+        throw std::invalid_argument("Cannot read cache directory " + dir +
+                                    ": " + std::strerror(errno));
+    }
+    for (struct dirent *entry; (entry = readdir(entries)) != nullptr;) {
+        const std::string name = entry->d_name;
+        if (endsWith(name, ".key") || endsWith(name, ".out")) {
+            bytes += fileSize(dir + "/" + name);
+        }
+    }
+    closedir(entries);
+}
+
+uint64_t
+ResultCache::hash(const char* data, size_t len, uint64_t hash) {
+    for (size_t i = 0; (i < len); i++) {
+        hash = (hash ^ static_cast<unsigned char>(data[i])) *
+            1099511628211ULL;
+    }
+    return hash;
+}
+
+std::string
+ResultCache::toHex(uint64_t value) {
+    return (boost::format("%016x") % value).str();
+}
+
+std::string
+ResultCache::entryPath(const std::string& key,
+                       const std::string& ext) const {
+    return dir + "/" + toHex(hash(key.c_str(), key.size())) + ext;
+}
+
+std::string
+ResultCache::getKey(const std::vector<StrVec>& commands,
+                    const StrVec& inputs) {
+    char cwd[PATH_MAX];
+    if (getcwd(cwd, sizeof(cwd)) == nullptr) {
+        uncacheable++;
+        return "";
+    }
+    // Each stage is "cmd" followed by " <length>:<word>" per word.
+    std::string key;
+    for (const auto& cmd : commands) {
+        key += "cmd";
+        for (const auto& word : cmd) {
+            key += " " + std::to_string(word.size()) + ":" + word;
+        }
+        key += "\n";
+    }
+    key += std::string("cwd ") + cwd + "\nenv " + envHash + "\n";
+    for (const auto& input : inputs) {
+        std::ifstream file(input, std::ios::binary);
+        if (!file) {
+            uncacheable++;
+            return "";
+        }
+        uint64_t value = hash("", 0);
+        char buf[65536];
+        while (file.read(buf, sizeof(buf)), file.gcount() > 0) {
+            value = hash(buf, file.gcount(), value);
+        }
+        key += "in " + input + " " + toHex(value) + "\n";
+    }
+    return key;
+}
+
+bool
+ResultCache::replay(const std::string& key, std::ostream& os, int& status) {
+    // The full key must match, in case of a collision of the hashes.
+    const std::string keyPath = entryPath(key, ".key");
+    std::ifstream keyFile(keyPath, std::ios::binary);
+    int stored = 0;
+    if (!(keyFile >> stored) || keyFile.get() != '\n' ||
+        std::string(std::istreambuf_iterator<char>(keyFile), {}) != key) {
+        misses++;
+        return false;
+    }
+    std::ifstream output(entryPath(key, ".out"), std::ios::binary);
+    if (!output) {
+        misses++;
+        return false;
+    }
+    // Writing an empty buffer would set the failbit of os.
+    if (output.peek() != EOF) {
+        os << output.rdbuf();
+    }
+    os << std::flush;
+    // Mark the entry as recently used, for eviction.
+    utimensat(AT_FDCWD, keyPath.c_str(), nullptr, 0);
+    status = stored;
+    hits++;
+    return true;
+}
+
+int
+ResultCache::createTemp(std::string& path) const {
+    std::string name = dir + "/tmp.XXXXXX";
+    // The descriptor is close-on-exec so that only the child it is
+    // given to (via dup2) writes to it.
+    const int fd = mkostemp(&name[0], O_CLOEXEC);
+    if (fd == -1) {
+        std::cerr << "Cannot create a file in " << dir << ": "
+                  << std::strerror(errno) << std::endl;
+    }
+    path = name;
+    return fd;
+}
+
+void
+ResultCache::store(const std::string& key, const std::string& tempPath,
+                   int status) {
+    const std::string outPath = entryPath(key, ".out");
+    const std::string keyPath = entryPath(key, ".key");
+    bytes -= std::min(bytes, fileSize(outPath) + fileSize(keyPath));
+    // The key file is written last, so that a partial entry is never
+    // used (e.g., if the shell is killed).
+    std::string keyTemp;
+    const int fd = createTemp(keyTemp);
+    if (fd == -1 || std::rename(tempPath.c_str(), outPath.c_str()) == -1) {
+        unlink(tempPath.c_str());
+        unlink(keyTemp.c_str());
+        close(fd);
+        return;
+    }
+    close(fd);
+    std::ofstream(keyTemp, std::ios::binary) << status << '\n' << key;
+    std::rename(keyTemp.c_str(), keyPath.c_str());
+    bytes += fileSize(outPath) + fileSize(keyPath);
+    stores++;
+    if (bytes > maxBytes) {
+        evict();
+    }
+}
+
+void
+ResultCache::evict() {
+    // The entries, least recently used first.
+    std::vector<std::pair<struct timespec, std::string>> entries;
+    DIR *dirp = opendir(dir.c_str());
+    if (dirp == nullptr) {
+        return;
+    }
+    for (struct dirent *entry; (entry = readdir(dirp)) != nullptr;) {
+        const std::string name = entry->d_name;
+        struct stat info;
+        if (endsWith(name, ".key") &&
+            stat((dir + "/" + name).c_str(), &info) == 0) {
+            entries.push_back({info.st_mtim,
+                               name.substr(0, name.size() - 4)});
+        }
+    }
+    closedir(dirp);
+    std::sort(entries.begin(), entries.end(), [](const auto& a,
+                                                 const auto& b) {
+        return std::make_pair(a.first.tv_sec, a.first.tv_nsec) <
+            std::make_pair(b.first.tv_sec, b.first.tv_nsec);
+    });
+    // Evict down to 90% of the budget, so that the directory is not
+    // scanned again on the very next store.
+    for (const auto& entry : entries) {
+        if (bytes <= maxBytes / 10 * 9) {
+            break;
+        }
+        const std::string base = dir + "/" + entry.second;
+        bytes -= std::min(bytes, fileSize(base + ".key") +
+                          fileSize(base + ".out"));
+        unlink((base + ".key").c_str());
+        unlink((base + ".out").c_str());
+        evictions++;
+    }
+}
+
+std::string
+ResultCache::report() const {
+    const size_t lookups = hits + misses;
+    return (boost::format("Cache: %d hits, %d misses (%.1f%% hit rate), "
+                          "%d not cacheable, %d stored, %d evicted, "
+                          "%.1f of %.1f MB used\n") % hits % misses %
+            (lookups == 0 ? 0.0 : 100.0 * hits / lookups) % uncacheable %
+            stores % evictions % (bytes / 1048576.0) %
+            (maxBytes / 1048576.0)).str();
+}
+
+#endif
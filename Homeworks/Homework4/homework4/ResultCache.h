@@ -0,0 +1,156 @@
+#ifndef RESULT_CACHE_H
+#define RESULT_CACHE_H
+
+/**
+ * A class to cache the results (standard output and exit code) of
+ * commands on disk, so that deterministic commands in scripts that
+ * are run again are replayed rather than re-run (as ccache does for
+ * compilers).  A replayed command does not run at all, so only pure
+ * commands (without side effects such as creating files) may be
+ * cached.  The scripts mark such commands (see JobScheduler).
+ *
+ * File:   ResultCache.h
+ * Author: Kyle Lierer
+ *
+ * Copyright (C) 2020 liererkt@miamioh.edu
+ */
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "ChildProcess.h"
+
+/**
+ * A content-addressed cache of the results of commands.  The key of a
+ * command consists of its command line, the working directory, the
+ * environment, and the contents of the input files it declares.
+ * Each entry is stored in the cache directory as two files named
+ * after a hash of the key:
+ *
+ *   - "<hash>.out" with the standard output of the command, and
+ *   - "<hash>.key" with the exit status followed by the full key.
+ *     The full key guards against hash collisions and, as it is
+ *     written last (via a rename), marks the entry as complete.
+ *
+ * When the entries exceed the size budget, the least recently used
+ * entries (by the modification time of their key files, which is
+ * updated on each hit) are removed.
+ */
+class ResultCache {
+public:
+    /**
+     * Opens (creating it if needed) a cache directory.
+     *
+     * \param[in] dir The directory where the entries are stored.
+     *
+     * \param[in] maxBytes The size budget for the entries in bytes.
+     *
+     * \exception std::invalid_argument If the directory cannot be
+     * created.
+     */
+    ResultCache(const std::string& dir, size_t maxBytes);
+
+    /**
+     * Returns the key for a command.  The words of the command are
+     * stored with their lengths (rather than joined with blanks), so
+     * that commands that differ only in their quoting (e.g., "a b"
+     * versus a b) have different keys.
+     *
+     * \param[in] commands The list of arguments of each stage of the
+     * command line to be run.
+     *
+     * \param[in] inputs The files the output of the command depends
+     * on.  Their contents are hashed into the key.
+     *
+     * \return The key, or an empty string if the command cannot be
+     * cached (i.e., an input file cannot be read).
+     */
+    std::string getKey(const std::vector<StrVec>& commands,
+                       const StrVec& inputs);
+
+    /**
+     * Writes the stored output of a command, if there is an entry for
+     * it in the cache.
+     *
+     * \param[in] key The key of the command (from getKey).
+     *
+     * \param[out] os The stream to where the output is written.
+     *
+     * \param[out] status The stored exit status (as from waitpid).
+     *
+     * \return True on a hit.
+     */
+    bool replay(const std::string& key, std::ostream& os, int& status);
+
+    /**
+     * Creates a temporary file in the cache directory, to which the
+     * output of a command is written while it runs.
+     *
+     * \param[out] path The path to the temporary file.
+     *
+     * \return The descriptor of the file (opened for writing) or -1
+     * on errors.
+     */
+    int createTemp(std::string& path) const;
+
+    /**
+     * Adds the output of a command to the cache, removing old entries
+     * if the cache exceeds its budget.
+     *
+     * \param[in] key The key of the command (from getKey).
+     *
+     * \param[in] tempPath The temporary file (from createTemp) with
+     * the output of the command.  The file is moved into the cache.
+     *
+     * \param[in] status The exit status of the command.
+     */
+    void store(const std::string& key, const std::string& tempPath,
+               int status);
+
+    /** Returns a one-line summary of the hits, misses, and the size
+        of the cache. */
+    std::string report() const;
+
+private:
+    /** Returns the 64-bit FNV-1a hash of some data.
+
+        \param[in] data The data to be hashed.
+
+        \param[in] len The number of bytes to be hashed.
+
+        \param[in] hash The hash of the data before this block (to
+        hash data in several blocks).
+    */
+    static uint64_t hash(const char* data, size_t len,
+                         uint64_t hash = 14695981039346656037ULL);
+
+    /** Returns the hash of a string as 16 hex digits. */
+    static std::string toHex(uint64_t value);
+
+    /** Returns the path of the given file of an entry. */
+    std::string entryPath(const std::string& key,
+                          const std::string& ext) const;
+
+    /** Removes the least recently used entries until the cache is
+        below its budget. */
+    void evict();
+
+    /** The directory where the entries are stored. */
+    const std::string dir;
+
+    /** The size budget for the entries in bytes. */
+    const size_t maxBytes;
+
+    /** The hash of the environment (computed once). */
+    std::string envHash;
+
+    /** The size of the entries in the cache. */
+    size_t bytes = 0;
+
+    /** Counters for the report. */
+    size_t hits = 0, misses = 0, uncacheable = 0, stores = 0,
+        evictions = 0;
+};
+
+#endif
@@ -0,0 +1,209 @@
+#ifndef SCRIPT_FETCHER_CPP
+#define SCRIPT_FETCHER_CPP
+
+/**
+ * Implementation of the class to download scripts in the background.
+ *
+ * File:   ScriptFetcher.cpp
+ * Author: Kyle Lierer
+ *
+ * Copyright (C) 2020 liererkt@miamioh.edu
+ */
+
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <boost/asio.hpp>
+#include <boost/format.hpp>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <tuple>
+#include "ScriptFetcher.h"
+#include "liererkt_hw4.h"
+
+ScriptFetcher::ScriptFetcher(const std::string& url, int timeout,
+                             int retries)
+    : url(url), timeout(timeout), retries(retries),
+      eventFd(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)),
+      startTime(Clock::now()) {
+    if (eventFd == -1) {
+        throw std::runtime_error("Call to eventfd failed: " +
+                                 std::string(std::strerror(errno)));
+    }
+    std::tie(host, port, path) = breakDownURL(url);
+    thread = std::thread(&ScriptFetcher::fetch, this);
+}
+
+ScriptFetcher::~ScriptFetcher() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
+        // Wake a blocked read (it sees the end of the data).
+        if (socketFd != -1) {
+            shutdown(socketFd, SHUT_RDWR);
+        }
+    }
+    stopped.notify_all();
+    thread.join();
+    close(eventFd);
+}
+
+ScriptFetcher::Status
+ScriptFetcher::next(std::string& line) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!lines.empty()) {
+        line = std::move(lines.front());
+        lines.pop_front();
+        return Status::Line;
+    } else if (done) {
+        return Status::End;
+    }
+    // Reset the eventfd (under the lock, so that a line pushed after
+    // this point signals it again).
+    uint64_t count;
+    if (read(eventFd, &count, sizeof(count)) == -1 && errno != EAGAIN) {
+        std::cerr << "Call to read failed: " << std::strerror(errno)
+                  << std::endl;
+    }
+    return Status::Pending;
+}
+
+void
+ScriptFetcher::push(const std::string& line, bool end) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (end) {
+        done    = true;
+        endTime = Clock::now();
+    } else {
+        lines.push_back(line);
+        if (lineCount++ == 0) {
+            firstLine = Clock::now();
+        }
+    }
+    const uint64_t one = 1;
+    if (write(eventFd, &one, sizeof(one)) == -1) {
+        std::cerr << "Call to write failed: " << std::strerror(errno)
+                  << std::endl;
+    }
+}
+
+void
+ScriptFetcher::fetch() {
+    std::string error;
+    for (int attempt = 1; ; attempt++) {
+        error.clear();
+        const Result result = download(error);
+        std::unique_lock<std::mutex> lock(mutex);
+        attempts = attempt;
+        if (result != Result::Retry || attempt > retries || stop) {
+            break;
+        }
+        // Wait a bit longer before each retry (unless stopped).
+        const auto delay = std::chrono::milliseconds(250 << (attempt - 1));
+        if (stopped.wait_for(lock, delay, [this] { return stop; })) {
+            break;
+        }
+    }
+    if (!error.empty()) {
+        std::cerr << "Error downloading " << url << ": " << error
+                  << std::endl;
+    }
+    push("", true);
+}
+
+ScriptFetcher::Result
+ScriptFetcher::download(std::string& error) {
+    using namespace boost::asio;
+    // Connecting and each read are limited by the timeout.
+    ip::tcp::iostream data;
+    data.expires_after(std::chrono::seconds(timeout));
+    data.connect(host, port);
+    if (!data) {
+        error = "Cannot connect: " + data.error().message();
+        return Result::Retry;
+    }
+    // The socket is registered (and unregistered before it is closed)
+    // under the lock, so the destructor never shuts down another one.
+    struct Registration {
+        ScriptFetcher& fetcher;
+        ~Registration() {
+            std::lock_guard<std::mutex> lock(fetcher.mutex);
+            fetcher.socketFd = -1;
+        }
+    };
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (stop) {
+            return Result::Done;
+        }
+        socketFd = data.socket().native_handle();
+    }
+    const Registration registration{*this};
+    data << "GET "   << path << " HTTP/1.1\r\n"
+         << "Host: " << host << "\r\n"
+         << "Connection: Close\r\n\r\n" << std::flush;
+
+    // Check the status line, e.g., "HTTP/1.1 200 OK".
+    std::string status, version;
+    int code = 0;
+    if (!std::getline(data, status)) {
+        error = "No response: " + data.error().message();
+        return Result::Retry;
+    }
+    std::istringstream(status) >> version >> code;
+    if (!status.empty() && status.back() == '\r') {
+        status.pop_back();
+    }
+    if (code < 200 || code >= 300) {
+        error = "Server replied: " + status;
+        return (code >= 500 ? Result::Retry : Result::Failed);
+    }
+
+    // Skip the response header.
+    for (std::string hdr; std::getline(data, hdr) &&
+        !hdr.empty() && hdr != "\r";) {}
+
+    // Queue each line as soon as it arrives.
+    size_t count = 0;
+    for (std::string line; data.expires_after(std::chrono::seconds(timeout)),
+             std::getline(data, line); count++) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (stop) {
+                return Result::Done;
+            }
+        }
+        push(line);
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (stop) {
+            return Result::Done;  // The socket was shut down.
+        }
+    }
+    if (data.error() && data.error() != error::eof) {
+        error = "Download failed after " + std::to_string(count) +
+            " lines: " + data.error().message();
+        // Lines that were queued may have run, so only retry if none.
+        return (count == 0 ? Result::Retry : Result::Failed);
+    }
+    return Result::Done;
+}
+
+std::string
+ScriptFetcher::report() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto secs = [this](Clock::time_point time) {
+        return std::chrono::duration<double>(time - startTime).count();
+    };
+    return (boost::format("Script: %d lines, first line after %.3fs, "
+                          "downloaded in %.3fs (%d attempts)\n") %
+            lineCount % (lineCount == 0 ? 0.0 : secs(firstLine)) %
+            (done ? secs(endTime) : 0.0) % attempts).str();
+}
+
+#endif
@@ -0,0 +1,138 @@
+#ifndef SCRIPT_FETCHER_H
+#define SCRIPT_FETCHER_H
+
+/**
+ * A class to download a script from a URL in the background, so that
+ * the shell can run (and reap) commands while the rest of the script
+ * is still being downloaded from a slow server.
+ *
+ * File:   ScriptFetcher.h
+ * Author: Kyle Lierer
+ *
+ * Copyright (C) 2020 liererkt@miamioh.edu
+ */
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+
+/**
+ * Downloads a script via HTTP on a separate thread and queues its
+ * lines as they arrive.  Connecting and each read are limited by a
+ * timeout.  Failures to connect, timeouts, and server errors (5xx)
+ * are retried (with increasing delays) as long as no line has been
+ * queued; once lines have been run a retry could run them twice.
+ *
+ * The queue has an eventfd that is readable when lines (or the end of
+ * the script) are available, so that the shell can wait for the next
+ * line and for its children at the same time.
+ */
+class ScriptFetcher {
+public:
+    /** The status returned by next. */
+    enum class Status { Line, Pending, End };
+
+    /**
+     * Starts downloading a script.
+     *
+     * \param[in] url The URL of the script, e.g.,
+     * "http://localhost:8080/cmds.txt".
+     *
+     * \param[in] timeout The maximum time to connect or to wait for
+     * more data, in seconds.
+     *
+     * \param[in] retries The number of times a failed download is
+     * retried.
+     */
+    explicit ScriptFetcher(const std::string& url, int timeout = 10,
+                           int retries = 3);
+
+    /** Stops the download (if it is still running) and waits for the
+        thread to finish.  A read in progress is interrupted by shutting
+        down the socket; a connect in progress still runs until it
+        finishes or times out. */
+    ~ScriptFetcher();
+
+    // The fetcher owns a thread and a descriptor and cannot be copied.
+    ScriptFetcher(const ScriptFetcher&) = delete;
+    ScriptFetcher& operator=(const ScriptFetcher&) = delete;
+
+    /**
+     * Returns the next line of the script, without blocking.
+     *
+     * \param[out] line The next line, if the status is Line.
+     *
+     * \return Line if a line was returned, Pending if the next line
+     * has not arrived yet (wait for fd to be readable), or End at
+     * the end of the script (or if it could not be downloaded).
+     */
+    Status next(std::string& line);
+
+    /** The eventfd that is readable when next would not return
+        Pending. */
+    int fd() const { return eventFd; }
+
+    /** Returns a one-line summary of the download (number of lines,
+        time to the first line, total time, and attempts). */
+    std::string report() const;
+
+private:
+    /** The results of an attempt to download the script. */
+    enum class Result { Done, Retry, Failed };
+
+    /** The method run by the thread: downloads the script, retrying
+        if needed. */
+    void fetch();
+
+    /** Makes one attempt to download the script.  On errors, sets
+        error and returns Retry or Failed. */
+    Result download(std::string& error);
+
+    /** Queues a line (or the end of the script, if end is true) and
+        signals the eventfd. */
+    void push(const std::string& line, bool end = false);
+
+    /** Shortcut to the clock used to time the download. */
+    using Clock = std::chrono::steady_clock;
+
+    /** The URL and its parts. */
+    const std::string url;
+    std::string host, port, path;
+
+    /** The timeout (in seconds) and number of retries. */
+    const int timeout, retries;
+
+    /** The eventfd signaled when lines are queued. */
+    const int eventFd;
+
+    /** The mutex and condition guarding the members below. */
+    mutable std::mutex mutex;
+    std::condition_variable stopped;
+
+    /** The lines that have arrived but have not been run. */
+    std::deque<std::string> lines;
+
+    /** True once the whole script has been queued. */
+    bool done = false;
+
+    /** True if the shell no longer needs the script. */
+    bool stop = false;
+
+    /** The socket being read by download (-1 if none), so that the
+        destructor can interrupt the read. */
+    int socketFd = -1;
+
+    /** Statistics for the report. */
+    size_t lineCount = 0;
+    int attempts = 0;
+    const Clock::time_point startTime;
+    Clock::time_point firstLine, endTime;
+
+    /** The thread that downloads the script (started last). */
+    std::thread thread;
+};
+
+#endif
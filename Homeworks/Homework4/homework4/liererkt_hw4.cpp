@@ -11,41 +11,157 @@
 
 #include "liererkt_hw4.h"
 
-#include <boost/asio.hpp>
+#include <unistd.h>
+
 #include <boost/format.hpp>
 
+#include <algorithm>
 #include <iostream>
 #include <string>
 #include <sstream>
 #include <fstream>
+#include <functional>
 #include <iomanip>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+
+// The options used by the shell.
+ShellOptions shellOptions;
+
+/**
+ * Helper method to convert a command-line argument to a positive
+ * number.
+ *
+ * \param[in] arg The argument to be converted.
+ *
+ * \param[in] what What the number is (for the error message).
+ *
+ * \return The number.
+ *
+ * \exception std::invalid_argument If the argument is not a positive
+ * number.
+ */
+static int toPositive(const std::string& arg, const std::string& what) {
+    std::istringstream is(arg);
+    int value = 0;
+    if (!(is >> value) || !is.eof() || value < 1) {
+        throw std::invalid_argument("Invalid " + what + ": " + arg);
+    }
+    return value;
+}
 
 /**
  * Starts the shell.
+ *
+ * \param[in] argc The number of command-line arguments.
+ *
+ * \param[in] argv The command-line arguments.  The optional "-s
+ * method" argument selects how child processes are created: "fork",
+ * "posix_spawn" (the default), "vfork", or "clone".  The "-r" option
+ * prints the resources used by each command.  The "-j N" option runs
+ * at most N commands at a time in PARALLEL mode (the default is the
+ * number of cores).  The "-c dir" option caches the results of
+ * the commands marked with "in:" or "cache:" in the given directory
+ * (see ResultCache and JobScheduler), using at most "-b MB" megabytes
+ * (64 by default).  The "-f" option forks every command, i.e.,
+ * disables the in-process builtins (see Builtins).
+ * The "-o completion|start" option prints the output of each job in
+ * PARALLEL mode as one block, in the order in which the jobs finish
+ * or start, and "-p" prefixes each of its lines with the job's tag.
  */
-int main() {    
+int main(int argc, char *argv[]) {
+    shellOptions.maxJobs = std::max(1u, std::thread::hardware_concurrency());
+    std::string cacheDir;
+    size_t cacheMB = 64;
+    try {
+        for (int opt; (opt = getopt(argc, argv, "b:c:fj:o:prs:")) != -1;) {
+            if (opt == 'b') {
+                cacheMB = toPositive(optarg, "cache size");
+            } else if (opt == 'c') {
+                cacheDir = optarg;
+            } else if (opt == 'f') {
+                Builtins::setEnabled(false);
+            } else if (opt == 'j') {
+                shellOptions.maxJobs = toPositive(optarg, "number of jobs");
+            } else if (opt == 'o') {
+                const std::string order = optarg;
+                if (order != "completion" && order != "start") {
+                    throw std::invalid_argument("Invalid output order: " +
+                                                order);
+                }
+                shellOptions.groupOutput = true;
+                shellOptions.outputOrder = (order == "start" ?
+                                            OutputMux::Order::Start :
+                                            OutputMux::Order::Completion);
+            } else if (opt == 'p') {
+                shellOptions.groupOutput  = true;
+                shellOptions.prefixOutput = true;
+            } else if (opt == 'r') {
+                shellOptions.showStats = true;
+            } else if (opt == 's') {
+                ChildProcess::setSpawnMethod(
+                    ChildProcess::toSpawnMethod(optarg));
+            } else {
+                throw std::invalid_argument("Invalid option");
+            }
+        }
+        if (!cacheDir.empty()) {
+            shellOptions.cache = std::make_unique<ResultCache>(
+                cacheDir, cacheMB << 20);
+        }
+    } catch (const std::invalid_argument& e) {
+        std::cerr << e.what() << "\nUsage: " << argv[0]
+                  << " [-c cache_dir [-b MB]] [-f] [-j jobs] "
+                  << "[-o completion|start] [-p] [-r] "
+                  << "[-s fork|posix_spawn|vfork|clone]\n";
+        return 1;
+    }
     process(std::cin, std::cout, "> ", false);
+    if (shellOptions.cache) {
+        std::cout << shellOptions.cache->report();
+    }
     return 0;
 }
 
-void process(std::istream& is, std::ostream& os, 
-        const std::string& prompt, bool parallel) {
+/**
+ * The type of the functions that read the next line of a script.  The
+ * function may run the jobs while it waits for the line.  It returns
+ * false at the end of the script.
+ */
+using LineReader = std::function<bool(std::string& line, JobScheduler& jobs)>;
+
+/**
+ * Helper method to run the commands of a script in either a
+ * serialized or parallelized manner (see process).
+ * @param nextLine The function that reads the lines of the script.
+ * @param os An output stream where the results of the commands are displayed.
+ * @param prompt An optional prompt that is displayed to the output stream.
+ * @param parallel Whether the commands are executed in a parallelized manner.
+ */
+static void runScript(const LineReader& nextLine, std::ostream& os,
+                      const std::string& prompt, bool parallel) {
     // Temporary variables used the store the entire line, command, 
     // and url if one is present.
     std::string line, cmd, url;
     
-    // A vector to keep track of child processes if run in parallel.
-    ChildVec vec;
+    // The commands are run as jobs that may depend on each other (see
+    // JobScheduler).  In serial mode, only one job runs at a time.
+    JobScheduler jobs(parallel ? shellOptions.maxJobs : 1,
+                      shellOptions.showStats, os, shellOptions.cache.get());
+    if (parallel && shellOptions.groupOutput) {
+        jobs.groupOutput(shellOptions.outputOrder, shellOptions.prefixOutput);
+    }
     
     // Outputs a prompt (if one is present) and retrieves the supplied line.
-    while (os << prompt, std::getline(is, line)) {
+    while (os << prompt, nextLine(line, jobs)) {
         // Gets the command and url (if one is present).
         std::istringstream ss(line);
         ss >> cmd >> url;
         
         // If the command is exit, stop processing.
         if (cmd == "exit") {
-            return;
+            break;
             
         // If the command is SERIAL, process all commands at the text file 
         // from the URL in a serialized manner.
@@ -60,61 +176,32 @@ void process(std::istream& is, std::ostream& os,
         // Otherwise, execute the line as a command in either a parallelized or 
         // serialized manner depending on the parallel parameter.
         } else {
-            ChildPair pair = execute(line);
-            // If it is not running in a parallelized manner, execute the
-            // command and then wait for a exit code.
-            // NOTE: If the line is either a comment or empty, the child will  
-            //       not execute and thus will not have a valid PID (PID < 0).
-            //       So, an exit code will not be displayed since it didn't 
-            //       execute.
-            if (!parallel && pair.second >= 0)
-                std::cout << "Exit code: " << pair.first.wait() << std::endl;
-            
-            // If it is not running in a parallelized manner, execute the
-            // command and add it to a vector to wait for exit codes later.
-            else if (pair.second >= 0)
-                vec.push_back(pair.first);
+            // The job starts as soon as its dependencies (if any) have
+            // finished and fewer than maxJobs jobs are running.
+            // NOTE: If the line is either a comment or empty, no job
+            //       is added.  So, an exit code will not be displayed
+            //       since it didn't execute.
+            jobs.add(line);
+            // If it is not running in a parallelized manner, wait for
+            // the exit code before reading the next command.
+            if (!parallel) {
+                jobs.wait();
+            }
         }
     }
-    // Wait for the exit code of all parallelized commands.
-    while (!vec.empty()) {
-       std::cout << "Exit code: " << vec.front().wait() << std::endl; 
-       vec.erase(vec.begin());
+    // Wait for the exit code of all parallelized commands in the order
+    // in which they finish.
+    jobs.wait();
+    if (parallel && (shellOptions.showStats || jobs.hasDependencies())) {
+        jobs.printReport();
     }
 }
 
-ChildPair execute(std::string command, std::ostream& os) { 
-    std::istringstream ss(command);
-
-    // Format the command to be executed on the child process by formatting it
-    // as a vector of strings.
-    StrVec vec;
-    for (std::string temp; ss >> std::quoted(temp);) {
-        vec.push_back(temp);
-    }
-    
-    // Creates a child process where the command where will be executed on.
-    ChildProcess child;
-    ChildPair pair;
-    pair.first = child;
-    
-    
-    // Exit if there is no command or it is a comment.
-    if (vec.empty() || vec.at(0) == "#") {
-        pair.second = -1;
-        return pair;
-    }
-    
-    // Print the current command being executed.
-    os << "Running:";
-    for (auto x : vec) {
-        os << ' ' << x;
-    }
-    os << std::endl;
-    
-    // Execute the command on a forked child process.
-    pair.second = child.forkNexec(vec);
-    return pair;
+void process(std::istream& is, std::ostream& os, 
+        const std::string& prompt, bool parallel) {
+    runScript([&is](std::string& line, JobScheduler&) {
+                  return static_cast<bool>(std::getline(is, line));
+              }, os, prompt, parallel);
 }
 
 std::tuple<std::string, std::string, std::string>
@@ -148,21 +235,27 @@ breakDownURL(const std::string& url) {
 }
 
 void processFromURL(std::string& url, std::ostream& os, bool parallel) {
-    // Download URL components. That is, given a URL 
-    std::string hostname, port, path;
-    std::tie(hostname, port, path) = breakDownURL(url);
-
     // Start the download of the file (that the user wants to be
-    // processed) at the specified URL.  We use a BOOST tcp::iostream.
-    boost::asio::ip::tcp::iostream data(hostname, port);
-    data << "GET "   << path     << " HTTP/1.1\r\n"
-         << "Host: " << hostname << "\r\n"
-         << "Connection: Close\r\n\r\n";
-
-    // Skip the response header.
-    for (std::string hdr; std::getline(data, hdr) && 
-        !hdr.empty() && hdr != "\r";) {}
-    
-    process(data, os, "", parallel);
+    // processed) at the specified URL.  The file is downloaded on a
+    // separate thread, so that the jobs keep running (and finished
+    // ones are reaped) while waiting for the rest of the file.
+    std::unique_ptr<ScriptFetcher> script;
+    try {
+        script = std::make_unique<ScriptFetcher>(url);
+    } catch (const std::runtime_error& e) {
+        std::cerr << e.what() << std::endl;
+        return;
+    }
+    runScript([&script](std::string& line, JobScheduler& jobs) {
+                  ScriptFetcher::Status status;
+                  while ((status = script->next(line)) ==
+                         ScriptFetcher::Status::Pending) {
+                      jobs.waitFor(script->fd());
+                  }
+                  return status == ScriptFetcher::Status::Line;
+              }, os, "", parallel);
+    if (shellOptions.showStats) {
+        os << script->report();
+    }
 }
 
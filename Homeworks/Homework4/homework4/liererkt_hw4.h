@@ -15,12 +15,47 @@
 #include <iostream>
 #include<string>
 #include <fstream>
+#include <memory>
 #include <vector>
 #include <utility>
 #include "ChildProcess.h"
+#include "JobScheduler.h"
+#include "ResultCache.h"
+#include "ScriptFetcher.h"
 
-using ChildVec = std::vector<ChildProcess>;
-using ChildPair = std::pair<ChildProcess, int>;
+/**
+ * The options (set via the command-line) that control how the shell
+ * runs commands.
+ */
+struct ShellOptions {
+    /** If true, the resource usage of each command is printed along
+        with its exit code. */
+    bool showStats = false;
+
+    /** The maximum number of commands run at the same time in
+        PARALLEL mode.  Set by main (by default, the number of
+        cores). */
+    size_t maxJobs = 1;
+
+    /** The cache for the results of commands.  Null (the default)
+        if the results are not cached. */
+    std::unique_ptr<ResultCache> cache;
+
+    /** If true, the output of each job in PARALLEL mode is printed
+        as one block (see OutputMux), in outputOrder. */
+    bool groupOutput = false;
+
+    /** The order in which the output of jobs is printed, if
+        grouped. */
+    OutputMux::Order outputOrder = OutputMux::Order::Completion;
+
+    /** If true, grouped lines are prefixed with the tags of their
+        jobs. */
+    bool prefixOutput = false;
+};
+
+/** The options used by the shell.  They are set by main. */
+extern ShellOptions shellOptions;
 
 /**
  * Reads commands in from an input stream and executes them in a serialized or 
@@ -42,15 +77,6 @@ void process(std::istream& is = std::cin, std::ostream& os = std::cout,
  */
 void processFromURL(std::string& url, std::ostream& os, bool parallel);
 
-/**
- * Executes a command and outputs the result.
- * @param command The command as a string.
- * @param os An output stream where the results of the commands are displayed.
- * @return A ChildPair which contains the ChildProcess the command was executed
- *         on as well the PID of the ChildPair.
- */
-ChildPair execute(std::string command, std::ostream& os = std::cout);
-
 /**
  * Helper method to break down a URL into hostname, port and path. For
  * example, given the url: "https://localhost:8080/~raodm/one.txt"
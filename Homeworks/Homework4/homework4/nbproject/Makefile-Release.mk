@@ -35,7 +35,14 @@ OBJECTDIR=${CND_BUILDDIR}/${CND_CONF}/${CND_PLATFORM}
 
 # Object Files
 OBJECTFILES= \
+	${OBJECTDIR}/Builtins.o \
 	${OBJECTDIR}/ChildProcess.o \
+	${OBJECTDIR}/ChildProcessGroup.o \
+	${OBJECTDIR}/JobScheduler.o \
+	${OBJECTDIR}/OutputMux.o \
+	${OBJECTDIR}/Pipeline.o \
+	${OBJECTDIR}/ResultCache.o \
+	${OBJECTDIR}/ScriptFetcher.o \
 	${OBJECTDIR}/liererkt_hw4.o
 
 
@@ -62,11 +69,46 @@ LDLIBSOPTIONS=
 homework4_opt: ${OBJECTFILES}
 	${LINK.cc} -o homework4_opt ${OBJECTFILES} ${LDLIBSOPTIONS} -lboost_system -lpthread -lmysqlpp
 
+${OBJECTDIR}/Builtins.o: Builtins.cpp
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -O2 -Wall -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/Builtins.o Builtins.cpp
+
 ${OBJECTDIR}/ChildProcess.o: ChildProcess.cpp
 	${MKDIR} -p ${OBJECTDIR}
 	${RM} "$@.d"
 	$(COMPILE.cc) -O2 -Wall -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/ChildProcess.o ChildProcess.cpp
 
+${OBJECTDIR}/ChildProcessGroup.o: ChildProcessGroup.cpp
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -O2 -Wall -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/ChildProcessGroup.o ChildProcessGroup.cpp
+
+${OBJECTDIR}/JobScheduler.o: JobScheduler.cpp
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -O2 -Wall -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/JobScheduler.o JobScheduler.cpp
+
+${OBJECTDIR}/OutputMux.o: OutputMux.cpp
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -O2 -Wall -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/OutputMux.o OutputMux.cpp
+
+${OBJECTDIR}/Pipeline.o: Pipeline.cpp
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -O2 -Wall -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/Pipeline.o Pipeline.cpp
+
+${OBJECTDIR}/ResultCache.o: ResultCache.cpp
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -O2 -Wall -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/ResultCache.o ResultCache.cpp
+
+${OBJECTDIR}/ScriptFetcher.o: ScriptFetcher.cpp
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -O2 -Wall -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/ScriptFetcher.o ScriptFetcher.cpp
+
 ${OBJECTDIR}/liererkt_hw4.o: liererkt_hw4.cpp
 	${MKDIR} -p ${OBJECTDIR}
 	${RM} "$@.d"
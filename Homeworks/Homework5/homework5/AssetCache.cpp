@@ -0,0 +1,266 @@
+#ifndef ASSET_CACHE_CPP
+#define ASSET_CACHE_CPP
+
+/**
+ * Implementation of the in-memory static file cache.
+ *
+ * File:   AssetCache.cpp
+ * Author: Kyle Lierer
+ *
+ * Copyright (C) 2020 liererkt@miamioh.edu
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <boost/format.hpp>
+#include <string>
+#include "AssetCache.h"
+#include "HTTPFile.h"
+
+/**
+ * Helper method to check if a file is the same version as the one
+ * described by the given inode, size, and modification time.
+ *
+ * \param[in] inode The inode of the file when it was read.
+ *
+ * \param[in] size The size of the file when it was read.
+ *
+ * \param[in] mtime The modification time of the file when it was read.
+ *
+ * \param[in] info The current status of the file (from stat).
+ *
+ * \return True if the file has not changed.
+ */
+static bool isSame(ino_t inode, off_t size, const timespec& mtime,
+                   const struct stat& info) {
+    return inode == info.st_ino && size == info.st_size &&
+        mtime.tv_sec == info.st_mtim.tv_sec &&
+        mtime.tv_nsec == info.st_mtim.tv_nsec;
+}
+
+/**
+ * Helper method to check if the cached entry corresponds to the
+ * current version of the file on disk.
+ *
+ * \param[in] entry The cached entry to be checked.
+ *
+ * \param[in] info The current status of the file (from stat).
+ *
+ * \return True if the file has not changed since it was cached.
+ */
+static bool isFresh(const http::asset& entry, const struct stat& info) {
+    return isSame(entry.inode, entry.size, entry.mtime, info);
+}
+
+/**
+ * Helper method to read the contents of a file.
+ *
+ * \param[in] fd The open file to read from.
+ *
+ * \param[in] size The number of bytes to be read.
+ *
+ * \param[out] data The contents of the file.
+ *
+ * \return True if all the bytes were read.
+ */
+static bool readFile(int fd, size_t size, std::string& data) {
+    data.resize(size);
+    for (size_t done = 0; done < size;) {
+        const ssize_t n = read(fd, &data[done], size - done);
+        if (n <= 0) {
+            return false;  // File shrunk or read error.
+        }
+        done += n;
+    }
+    return true;
+}
+
+/**
+ * Helper method to read a precompressed sibling of a file.  Siblings
+ * older than the file are out of date and are ignored.
+ *
+ * \param[in] path The path to the compressed file.
+ *
+ * \param[in] orig The status of the original (uncompressed) file.
+ *
+ * \param[in] maxSize Files larger than this size are not read.
+ *
+ * \param[out] data The contents of the file.
+ *
+ * \param[out] info The status of the compressed file that was read.
+ *
+ * \return True if the file was read.
+ */
+static bool readSibling(const std::string& path, const struct stat& orig,
+                        size_t maxSize, std::string& data,
+                        struct stat& info) {
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return false;
+    }
+    const bool ok = fstat(fd, &info) == 0 && S_ISREG(info.st_mode) &&
+        info.st_mtime >= orig.st_mtime &&
+        static_cast<size_t>(info.st_size) <= maxSize &&
+        readFile(fd, info.st_size, data);
+    close(fd);
+    return ok;
+}
+
+http::AssetCache::AssetCache(size_t budget, size_t maxFileSize) :
+    budget(budget), maxFileSize(maxFileSize) {
+    // Instance variables are initialized and not assigned!
+}
+
+http::AssetCache&
+http::AssetCache::instance() {
+    static AssetCache cache;
+    return cache;
+}
+
+http::AssetPtr
+http::AssetCache::get(const std::string& path, const std::string& encoding) {
+    struct stat info;
+    if (stat(path.c_str(), &info) == -1) {
+        return nullptr;
+    }
+    // Each encoding of a file is a separate entry.
+    const std::string key = (encoding.empty() ? path : path + ';' + encoding);
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+        auto entry = entries.find(key);
+        if (entry != entries.end()) {
+            const asset& cached = *entry->second.first;
+            struct stat sibInfo;
+            if (isFresh(cached, info) &&
+                (!cached.fromSibling ||
+                 (stat((path + ".gz").c_str(), &sibInfo) == 0 &&
+                  isSame(cached.siblingInode, cached.siblingSize,
+                         cached.siblingMtime, sibInfo)))) {
+                // Hit. Move the path to the front of the LRU list.
+                lru.splice(lru.begin(), lru, entry->second.second);
+                hitCount++;
+                return entry->second.first;
+            }
+            // The file (or its sibling) has been modified. Discard
+            // the stale entry.
+            erase(key);
+        }
+    }
+    // Miss. Read (and compress) the file without holding the lock so
+    // that other threads can continue to use the cache.
+    missCount++;
+    AssetPtr entry = load(path, encoding);
+    if (entry != nullptr) {
+        std::lock_guard<std::mutex> guard(mutex);
+        insert(key, entry);
+    }
+    return entry;
+}
+
+http::AssetPtr
+http::AssetCache::load(const std::string& path,
+                       const std::string& encoding) const {
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return nullptr;
+    }
+    // The status of the open file is used so that the entry matches
+    // the data that is actually read.
+    struct stat info;
+    if (fstat(fd, &info) == -1 || !S_ISREG(info.st_mode) ||
+        static_cast<size_t>(info.st_size) > maxFileSize) {
+        close(fd);
+        return nullptr;
+    }
+    std::string body, packed;
+    struct stat sibInfo;
+    const bool ok = readFile(fd, info.st_size, body);
+    close(fd);
+    if (!ok) {
+        return nullptr;  // Do not cache a partially read file.
+    }
+    // Use a precompressed sibling or compress the file. The
+    // compressed body is used only if it is smaller.
+    const bool sibling = (encoding == "gzip" &&
+                          readSibling(path + ".gz", info, maxFileSize,
+                                      packed, sibInfo));
+    const bool compressed = !encoding.empty() &&
+        (sibling || compress(body, encoding, packed)) &&
+        packed.size() < body.size();
+    if (compressed) {
+        body.swap(packed);
+    }
+    auto entry = std::make_shared<asset>();
+    if (compressed && sibling) {
+        entry->fromSibling  = true;
+        entry->siblingInode = sibInfo.st_ino;
+        entry->siblingSize  = sibInfo.st_size;
+        entry->siblingMtime = sibInfo.st_mtim;
+    }
+    entry->inode = info.st_ino;
+    entry->size  = info.st_size;
+    entry->mtime = info.st_mtim;
+    entry->encoding     = (compressed ? encoding : "");
+    entry->etag         = getETag(info, entry->encoding);
+    entry->lastModified = toHttpDate(info.st_mtime);
+    entry->data  = getStaticHeaders(path, body.size(), entry->encoding,
+                                    getValidators(entry->etag,
+                                                  entry->lastModified));
+    entry->bodyOffset = entry->data.size();
+    entry->data += body;
+    return entry;
+}
+
+void
+http::AssetCache::insert(const std::string& path, const AssetPtr& entry) {
+    if (entry->data.size() > budget) {
+        return;  // Would evict everything else. Do not cache.
+    }
+    // Another thread may have loaded the same file concurrently.
+    if (entries.find(path) != entries.end()) {
+        erase(path);
+    }
+    // Evict least-recently-used entries to stay within the budget.
+    while (used + entry->data.size() > budget) {
+        const std::string victim = lru.back();
+        erase(victim);
+        evictCount++;
+    }
+    lru.push_front(path);
+    entries[path] = {entry, lru.begin()};
+    used += entry->data.size();
+}
+
+void
+http::AssetCache::erase(const std::string& path) {
+    auto entry = entries.find(path);
+    used -= entry->second.first->data.size();
+    lru.erase(entry->second.second);
+    entries.erase(entry);
+}
+
+void
+http::AssetCache::clear() {
+    std::lock_guard<std::mutex> guard(mutex);
+    entries.clear();
+    lru.clear();
+    used = 0;
+}
+
+size_t
+http::AssetCache::size() const {
+    std::lock_guard<std::mutex> guard(mutex);
+    return used;
+}
+
+std::string
+http::AssetCache::report() const {
+    const size_t hits = hitCount, misses = missCount;
+    return (boost::format("File cache: %d hits, %d misses (%.1f%% hit "
+                          "rate), %d evicted, %.1f of %.1f MB used\n") %
+            hits % misses %
+            (hits + misses == 0 ? 0.0 : 100.0 * hits / (hits + misses)) %
+            evictCount % (size() / 1048576.0) % (budget / 1048576.0)).str();
+}
+
+#endif
@@ -0,0 +1,188 @@
+#ifndef ASSET_CACHE_H
+#define ASSET_CACHE_H
+
+/**
+ * A process-wide in-memory cache of small static files (such as
+ * index.html, terminal.css, or favicon.ico) along with their
+ * preassembled HTTP response headers.  Cached files are sent to the
+ * client with a single (scatter-gather) write.  Compressed variants
+ * of text files are cached separately so that each file is
+ * compressed only once.
+ *
+ * File:   AssetCache.h
+ * Author: Kyle Lierer
+ *
+ * Copyright (C) 2020 liererkt@miamioh.edu
+ */
+
+#include <sys/stat.h>
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace http {
+    /**
+     * A single file in the cache.  Entries are never modified once
+     * created and hence can be safely shared between threads.
+     */
+    class asset {
+    public:
+        /** The HTTP response, i.e., headers (except the Connection
+            header) followed by the contents of the file. */
+        std::string data;
+
+        /** The offset in data where the contents of the file start. */
+        size_t bodyOffset;
+
+        /** The content coding of the body ("" if not compressed). */
+        std::string encoding;
+
+        /** The entity tag of the body (for conditional requests). */
+        std::string etag;
+
+        /** The Last-Modified date of the file in HTTP format. */
+        std::string lastModified;
+
+        /** The inode of the file when it was read. */
+        ino_t inode;
+
+        /** The size of the file when it was read. */
+        off_t size;
+
+        /** The last modification time of the file when it was read.
+            The entry is stale if the file's time changes.  For
+            compressed variants these fields describe the original
+            (uncompressed) file. */
+        timespec mtime;
+
+        /** True if the body was read from a precompressed sibling
+            (the file with ".gz" added). */
+        bool fromSibling = false;
+
+        /** The inode, size, and modification time of the sibling
+            when it was read.  The entry is also stale if the sibling
+            changes. */
+        ino_t siblingInode = 0;
+        off_t siblingSize  = 0;
+        timespec siblingMtime = {};
+    };
+
+    /** Shortcut to a shared pointer to a cached file. */
+    using AssetPtr = std::shared_ptr<const asset>;
+
+    /**
+     * A thread-safe cache of files with least-recently-used (LRU)
+     * eviction once the total size of the cached data exceeds a
+     * budget.  Each lookup checks (using stat) if the file has been
+     * modified since it was cached and if so reloads the file.
+     */
+    class AssetCache {
+    public:
+        /** The default total size of all the entries in the cache */
+        static const size_t DefaultBudget = 16 << 20;
+
+        /** The default maximum size of a file that is cached */
+        static const size_t DefaultMaxFileSize = 1 << 20;
+
+        /** Creates an empty cache.
+
+            \param[in] budget The maximum total size (in bytes) of all
+            the responses in the cache.
+
+            \param[in] maxFileSize Files larger than this size are not
+            cached.
+        */
+        explicit AssetCache(size_t budget = DefaultBudget,
+                            size_t maxFileSize = DefaultMaxFileSize);
+
+        /** The process-wide cache used by http::file. */
+        static AssetCache& instance();
+
+        /**
+         * Returns the cached response for the given file, loading it
+         * into the cache if it is not present or is stale (i.e., the
+         * file or the precompressed sibling it was read from has
+         * changed).
+         *
+         * \param[in] path The path to the file.
+         *
+         * \param[in] encoding The content coding of the response
+         * ("gzip" or "deflate"), if any.  For gzip, a precompressed
+         * sibling file (path + ".gz") is used if present. Otherwise
+         * the file is compressed when it is loaded.  If compression
+         * does not make the file smaller, the entry is the
+         * uncompressed response.
+         *
+         * \return The cached entry.  This method returns nullptr if
+         * the file is not a regular file or is too big to be cached.
+         */
+        AssetPtr get(const std::string& path,
+                     const std::string& encoding = "");
+
+        /** Removes all the entries from the cache. */
+        void clear();
+
+        /** The number of lookups that were served from the cache. */
+        size_t hits() const { return hitCount; }
+
+        /** The number of lookups that had to read the file. */
+        size_t misses() const { return missCount; }
+
+        /** The number of entries evicted to stay within budget. */
+        size_t evictions() const { return evictCount; }
+
+        /** The total size (in bytes) of all the cached responses. */
+        size_t size() const;
+
+        /** Returns a one-line summary of the hits, misses, evictions,
+            and the size of the cache. */
+        std::string report() const;
+
+    private:
+        /** Shortcut to the list of paths in least-recently-used order */
+        using LruList = std::list<std::string>;
+
+        /** Reads the file (and compresses it for the given
+            encoding) into a new entry.  Returns nullptr if the file
+            is not cacheable. */
+        AssetPtr load(const std::string& path,
+                      const std::string& encoding) const;
+
+        /** Adds/replaces the entry for the path, evicting old entries
+            as needed.  The mutex must be held by the caller. */
+        void insert(const std::string& path, const AssetPtr& entry);
+
+        /** Removes the entry for the given path.  The mutex must be
+            held by the caller. */
+        void erase(const std::string& path);
+
+        /** The maximum total size of the cached responses. */
+        const size_t budget;
+
+        /** Files larger than this size are not cached. */
+        const size_t maxFileSize;
+
+        /** The mutex to guard the map, the list, and the usage. */
+        mutable std::mutex mutex;
+
+        /** The keys (the path and the encoding, if any) of the
+            entries in the cache, most recently used first. */
+        LruList lru;
+
+        /** The entries in the cache (indexed by key) along with their
+            position in the LRU list. */
+        std::unordered_map<std::string,
+                           std::pair<AssetPtr, LruList::iterator>> entries;
+
+        /** The total size of all the cached responses. */
+        size_t used = 0;
+
+        /** The counters for cache statistics. */
+        std::atomic<size_t> hitCount{0}, missCount{0}, evictCount{0};
+    };
+}  // namespace http
+
+#endif
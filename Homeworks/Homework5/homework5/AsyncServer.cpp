@@ -0,0 +1,402 @@
+#ifndef ASYNC_SERVER_CPP
+#define ASYNC_SERVER_CPP
+
+/**
+ * Implementation of the event-driven web-server.
+ *
+ * File:   AsyncServer.cpp
+ * Author: Kyle Lierer
+ *
+ * Copyright (C) 2020 liererkt@miamioh.edu
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/sendfile.h>
+#include <cerrno>
+#include <csignal>
+#include <algorithm>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include "AsyncServer.h"
+#include "CmdStats.h"
+#include "HTTPFile.h"
+#include "liererkt_hw5.h"
+
+// Convenience namespace to streamline the code below.
+using namespace boost::asio;
+using namespace boost::asio::ip;
+using boost::system::error_code;
+
+/** The trailing chunk that finishes a chunked HTTP response */
+const std::string LastChunk = "0\r\n\r\n";
+
+/** The line terminator that follows the data in each chunk */
+const std::string ChunkEnd = "\r\n";
+
+/** How long a persistent connection may stay idle between requests */
+const std::chrono::seconds IdleTimeout(15);
+
+ChildReaper::ChildReaper(io_service& service) : signals(service, SIGCHLD) {
+    waitSignal();
+}
+
+void
+ChildReaper::reap(ChildProcess& child, std::function<void()> done) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending.emplace_back(&child, std::move(done));
+    }
+    // The child may have exited before it was added to the list.
+    // Check all the pending children so that its signal is not lost.
+    post(signals.get_executor(), [this] { onSignal(); });
+}
+
+void
+ChildReaper::waitSignal() {
+    signals.async_wait([this](const error_code& ec, int) {
+        if (!ec) {
+            onSignal();
+            waitSignal();
+        }
+    });
+}
+
+void
+ChildReaper::onSignal() {
+    // Several exits may be reported by a single signal, so every
+    // pending child is checked.
+    std::vector<std::function<void()>> finished;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto entry = pending.begin(); entry != pending.end();) {
+            if (entry->first->tryWait()) {
+                finished.push_back(std::move(entry->second));
+                entry = pending.erase(entry);
+            } else {
+                entry++;
+            }
+        }
+    }
+    for (auto& done : finished) {
+        done();
+    }
+}
+
+Connection::Connection(io_service& service, ChildReaper& reaper) :
+    strand(service), sock(service), idleTimer(service), reaper(reaper),
+    pipe(service) {
+    // Instance variables are initialized and not assigned!
+}
+
+void
+Connection::start() {
+    auto self = shared_from_this();
+    // Close the connection if the next request does not arrive in time.
+    waiting = true;
+    idleTimer.expires_after(IdleTimeout);
+    idleTimer.async_wait(strand.wrap([self](const error_code& ec) {
+        // The timer may have expired just as a request arrived.
+        if (!ec && self->waiting &&
+            self->idleTimer.expiry() <= std::chrono::steady_clock::now()) {
+            self->close();
+        }
+    }));
+    // Read the request line and all the headers.
+    async_read_until(sock, request, "\r\n\r\n",
+                     strand.wrap([self](const error_code& ec, size_t) {
+                         self->onRequest(ec);
+                     }));
+}
+
+void
+Connection::onRequest(const error_code& ec) {
+    waiting = false;
+    idleTimer.cancel();
+    if (ec) {
+        close();  // Client disconnected or timed out.
+        return;
+    }
+    // Parse the request line and headers.  Any pipelined requests
+    // remain in the buffer for the next call to start().
+    std::istream is(&request);
+    if (!(is >> req) && is.eof()) {
+        start();  // Only empty lines. Wait for the actual request.
+        return;
+    }
+    // Skip the body (if any) that follows the headers.
+    size_t bodyLen = 0;
+    if (!is || !req.contentLength(bodyLen)) {
+        // The request cannot be framed, so reply and drop the connection.
+        keepAlive = false;
+        auto self = shared_from_this();
+        async_write(sock, buffer(BadRequestResponse),
+                    strand.wrap([self](const error_code&, size_t) {
+                        self->close();
+                    }));
+        return;
+    }
+    keepAlive = req.keepAlive();
+    if (request.size() >= bodyLen) {
+        request.consume(bodyLen);
+        dispatch();
+        return;
+    }
+    const size_t missing = bodyLen - request.size();
+    request.consume(request.size());
+    auto self = shared_from_this();
+    async_read(sock, request, transfer_exactly(missing),
+               strand.wrap([self](const error_code& ec, size_t len) {
+                   if (ec) {
+                       self->close();
+                       return;
+                   }
+                   self->request.consume(len);
+                   self->dispatch();
+               }));
+}
+
+void
+Connection::dispatch() {
+    // Use the same routing logic as serveClient.
+    const std::string relUrl = extractRelUrl(req.path);
+    std::string cmd;
+    if (relUrl == "stats" && CmdStats::instance().isEnabled()) {
+        fileResp = std::make_unique<http::response>();
+        CmdStats::instance().prepare(*fileResp, keepAlive);
+        sendResponse();
+    } else if (getCommand(relUrl, cmd)) {
+        runCmd(cmd);
+    } else {
+        sendFile(relUrl);
+    }
+}
+
+void
+Connection::sendFile(const std::string& path) {
+    fileResp = std::make_unique<http::response>();
+    http::file(path, req, true).prepare(*fileResp);
+    sendResponse();
+}
+
+void
+Connection::sendResponse() {
+    // Cork the socket so that the headers and the start of the file
+    // go out in full-sized segments.
+    if (fileResp->remaining > 0) {
+        setCork(true);
+    }
+    // Send the in-memory parts (the whole response for cached files)
+    // with one scatter-gather write.
+    std::vector<const_buffer> head;
+    for (const iovec& part : fileResp->buffers()) {
+        head.push_back(buffer(part.iov_base, part.iov_len));
+    }
+    auto self = shared_from_this();
+    async_write(sock, head,
+                strand.wrap([self](const error_code& ec, size_t) {
+                    if (ec) {
+                        self->close();
+                        return;
+                    }
+                    self->sendFileBody();
+                }));
+}
+
+void
+Connection::sendFileBody() {
+    sock.native_non_blocking(true);
+    // Have the kernel copy the file's pages directly to the socket
+    // until the socket's buffer is full.
+    while (fileResp->remaining > 0) {
+        const ssize_t n = sendfile(sock.native_handle(), fileResp->fd,
+                                   &fileResp->offset, fileResp->remaining);
+        if (n > 0) {
+            fileResp->remaining -= n;
+        } else if (n == -1 && errno == EAGAIN) {
+            // Socket's buffer is full. Resume once it is writable.
+            auto self = shared_from_this();
+            sock.async_wait(tcp::socket::wait_write,
+                            strand.wrap([self](const error_code& ec) {
+                                if (ec) {
+                                    self->close();
+                                    return;
+                                }
+                                self->sendFileBody();
+                            }));
+            return;
+        } else {
+            close();  // Client disconnected or file error.
+            return;
+        }
+    }
+    setCork(false);
+    fileResp.reset();  // Close the file.
+    finish();
+}
+
+void
+Connection::setCork(bool cork) {
+    const int val = cork;
+    setsockopt(sock.native_handle(), IPPROTO_TCP, TCP_CORK, &val,
+               sizeof(val));
+}
+
+void
+Connection::runCmd(const std::string& cmd) {
+    const StrVec args = ChildProcess::split(cmd);
+    program = (args.empty() ? "" : args.front());
+    child.forkNexecIO(args);
+    // The descriptor is duplicated because both the stream_descriptor
+    // and the child's stdio_filebuf close the descriptor they own.
+    pipe.assign(dup(child.getChildOutputFd()));
+    auto self = shared_from_this();
+    async_write(sock, buffer(keepAlive ? KeepAliveHTTPHeaders : HTTPHeaders),
+                strand.wrap([self](const error_code& ec, size_t) {
+                    if (ec) {
+                        self->abortCmd();
+                        return;
+                    }
+                    self->readCmdOutput();
+                }));
+}
+
+void
+Connection::readCmdOutput() {
+    auto self = shared_from_this();
+    pipe.async_read_some(buffer(buf),
+                         strand.wrap([self](const error_code& ec,
+                                            size_t len) {
+                             self->onCmdOutput(ec, len);
+                         }));
+}
+
+void
+Connection::onCmdOutput(const error_code& ec, size_t len) {
+    auto self = shared_from_this();
+    if (ec) {
+        // End of output. Reap the child (without blocking this
+        // thread) and then send the trailing chunk.
+        pipe.close();
+        reaper.reap(child, strand.wrap([self] { self->onCmdDone(); }));
+        return;
+    }
+    // Combine any further output that is already available into the
+    // same chunk (without waiting) to reduce the number of writes.
+    error_code more;
+    pipe.non_blocking(true, more);
+    while (!more && len < buf.size()) {
+        len += pipe.read_some(buffer(buf.data() + len, buf.size() - len),
+                              more);
+    }
+    // Send whatever was read as one chunk using scatter-gather I/O
+    // to avoid copying the data.  A pending end-of-file is seen by
+    // the next read.
+    std::ostringstream hex;
+    hex << std::hex << len << "\r\n";
+    chunkHdr = hex.str();
+    const std::array<const_buffer, 3> chunk = {
+        buffer(chunkHdr), buffer(buf.data(), len), buffer(ChunkEnd)};
+    async_write(sock, chunk, strand.wrap([self](const error_code& ec,
+                                                size_t) {
+        if (ec) {
+            self->abortCmd();
+            return;
+        }
+        self->readCmdOutput();
+    }));
+}
+
+void
+Connection::onCmdDone() {
+    if (!program.empty()) {
+        CmdStats::instance().record(program, child.getStats());
+    }
+    auto self = shared_from_this();
+    async_write(sock, buffer(LastChunk),
+                strand.wrap([self](const error_code& ec, size_t) {
+                    if (ec) {
+                        self->close();
+                        return;
+                    }
+                    self->finish();
+                }));
+}
+
+void
+Connection::abortCmd() {
+    // Closing both descriptors of the pipe makes a command that is
+    // still writing exit (with SIGPIPE). The connection lives until
+    // the child is reaped.
+    error_code ignored;
+    pipe.close(ignored);
+    child.closeChildOutput();
+    close();
+    auto self = shared_from_this();
+    reaper.reap(child, strand.wrap([self] {}));
+}
+
+void
+Connection::finish() {
+    if (keepAlive) {
+        start();  // Process the next request on this connection.
+    } else {
+        close();
+    }
+}
+
+void
+Connection::close() {
+    error_code ignored;
+    idleTimer.cancel(ignored);
+    sock.shutdown(tcp::socket::shutdown_both, ignored);
+    sock.close(ignored);
+}
+
+AsyncServer::AsyncServer(io_service& service, int port) :
+    service(service), acceptor(service, tcp::endpoint(tcp::v4(), port)),
+    reaper(service) {
+    std::cout << "Server is listening on "
+              << acceptor.local_endpoint().port()
+              << " & ready to process clients...\n";
+}
+
+void
+AsyncServer::accept() {
+    auto conn = std::make_shared<Connection>(service, reaper);
+    acceptor.async_accept(conn->socket(), [this, conn](const error_code& ec) {
+        if (!ec) {
+            // Do not leak client sockets into commands run by others.
+            fcntl(conn->socket().native_handle(), F_SETFD, FD_CLOEXEC);
+            // Send responses right away instead of waiting for the
+            // client to acknowledge earlier responses.
+            conn->socket().set_option(tcp::no_delay(true));
+            conn->start();
+        }
+        accept();
+    });
+}
+
+void
+AsyncServer::run(int numThreads) {
+    if (numThreads <= 0) {
+        numThreads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    fcntl(acceptor.native_handle(), F_SETFD, FD_CLOEXEC);
+    accept();
+    // Run the io_service on the given number of threads (including
+    // this one) and wait for all of them.
+    std::vector<std::thread> threads;
+    for (int i = 1; i < numThreads; i++) {
+        threads.emplace_back([this] { service.run(); });
+    }
+    service.run();
+    for (auto& thr : threads) {
+        thr.join();
+    }
+}
+
+#endif
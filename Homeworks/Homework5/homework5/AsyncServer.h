@@ -0,0 +1,223 @@
+#ifndef ASYNC_SERVER_H
+#define ASYNC_SERVER_H
+
+/**
+ * An event-driven web-server that serves many clients concurrently
+ * using a fixed number of threads.  Requests are processed with the
+ * same semantics as serveClient (files and "cgi-bin/exec" commands),
+ * but no thread ever blocks on a slow client or a long running
+ * command.
+ *
+ * File:   AsyncServer.h
+ * Author: Kyle Lierer
+ *
+ * Copyright (C) 2020 liererkt@miamioh.edu
+ */
+
+#include <boost/asio.hpp>
+#include <array>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include "ChildProcess.h"
+#include "HTTPFile.h"
+#include "HTTPRequest.h"
+
+/**
+ * Reaps child processes without blocking any thread of the
+ * io_service.  Each SIGCHLD (delivered via a signal_set) triggers a
+ * non-blocking wait for all the children that have been handed to
+ * reap.  A command that closes its output but keeps running hence
+ * does not stall other connections.
+ */
+class ChildReaper {
+public:
+    /** Starts handling SIGCHLD.  This must be done before any child
+        is handed to reap.
+
+        \param[in] service The I/O service used to deliver signals.
+    */
+    explicit ChildReaper(boost::asio::io_service& service);
+
+    /** Reaps the given child once it finishes.
+
+        \param[in] child The child to be reaped.  It must remain valid
+        until done is called.
+
+        \param[in] done Called (from a thread running the
+        io_service) once the child has been reaped.
+    */
+    void reap(ChildProcess& child, std::function<void()> done);
+
+private:
+    /** Waits for the next SIGCHLD. */
+    void waitSignal();
+
+    /** Reaps the pending children that have finished. */
+    void onSignal();
+
+    /** The set containing SIGCHLD. */
+    boost::asio::signal_set signals;
+
+    /** Guards pending (signals may be handled by any thread). */
+    std::mutex mutex;
+
+    /** The children yet to finish along with their callbacks. */
+    std::vector<std::pair<ChildProcess*, std::function<void()>>> pending;
+};
+
+/**
+ * The state associated with a single client connection.  Each
+ * connection has at most one asynchronous I/O operation pending at
+ * any time (plus the idle timer) and is kept alive by the shared
+ * pointers held by the pending handlers.  Requests on a persistent
+ * connection are processed one after another, so responses to
+ * pipelined requests are sent in order.
+ */
+class Connection : public std::enable_shared_from_this<Connection> {
+public:
+    /** Creates a connection whose socket is yet to be accepted.
+
+        \param[in] service The I/O service used for all operations.
+
+        \param[in] reaper Reaps the commands run for this connection.
+    */
+    Connection(boost::asio::io_service& service, ChildReaper& reaper);
+
+    /** The socket to be used with the acceptor. */
+    boost::asio::ip::tcp::socket& socket() { return sock; }
+
+    /** Starts processing the client by reading the (next) HTTP
+        request. */
+    void start();
+
+private:
+    /** Parses the request once the headers are read and skips the
+        body (if any). */
+    void onRequest(const boost::system::error_code& ec);
+
+    /** Routes the request to a file, a command, or the statistics. */
+    void dispatch();
+
+    /** Sends the response for a file request. */
+    void sendFile(const std::string& path);
+
+    /** Sends the in-memory parts of fileResp followed by the body
+        (if any) from its file. */
+    void sendResponse();
+
+    /** Sends (the rest of) the body of a file request using
+        sendfile, waiting for the socket to be writable as needed. */
+    void sendFileBody();
+
+    /** Runs the command and starts streaming its output. */
+    void runCmd(const std::string& cmd);
+
+    /** Reads the next block of output from the command. */
+    void readCmdOutput();
+
+    /** Writes a block of command output as a HTTP chunk. */
+    void onCmdOutput(const boost::system::error_code& ec, size_t len);
+
+    /** Called once the command has finished and has been reaped.
+        Records its statistics and ends the chunked response. */
+    void onCmdDone();
+
+    /** Closes the connection after a failed write to the client
+        while a command is running.  The command is still reaped. */
+    void abortCmd();
+
+    /** Sets or clears TCP_CORK on the socket. */
+    void setCork(bool cork);
+
+    /** Called after a response is sent.  Starts reading the next
+        request on persistent connections or closes the connection. */
+    void finish();
+
+    /** Gracefully closes the connection. */
+    void close();
+
+    /** Serializes the handlers for this connection (the idle timer
+        may fire on one thread while I/O completes on another). */
+    boost::asio::io_service::strand strand;
+
+    /** The socket connected to the client. */
+    boost::asio::ip::tcp::socket sock;
+
+    /** Closes the connection if the client is idle for too long. */
+    boost::asio::steady_timer idleTimer;
+
+    /** Buffer holding the HTTP request read from the client. */
+    boost::asio::streambuf request;
+
+    /** The current request being processed. */
+    http::request req;
+
+    /** Whether the connection is kept open after this response. */
+    bool keepAlive = false;
+
+    /** Whether the connection is waiting for the next request. */
+    bool waiting = false;
+
+    /** The response to a file request (must live until written). */
+    std::unique_ptr<http::response> fileResp;
+
+    /** Reaps child processes without blocking. */
+    ChildReaper& reaper;
+
+    /** The child process running a command for this client. */
+    ChildProcess child;
+
+    /** The program run by the child (for CmdStats). */
+    std::string program;
+
+    /** Asynchronous wrapper around the child's output pipe. */
+    boost::asio::posix::stream_descriptor pipe;
+
+    /** The hex-length line for the chunk being written. */
+    std::string chunkHdr;
+
+    /** Buffer for output read from the child process. */
+    std::array<char, 65536> buf;
+};
+
+/**
+ * The server that accepts connections and dispatches them to the
+ * Connection objects.  All the I/O is multiplexed by the io_service.
+ */
+class AsyncServer {
+public:
+    /** Creates the server socket.
+
+        \param[in] service The I/O service used for all operations.
+
+        \param[in] port The port to listen on.  If zero, the operating
+        system assigns a port.
+    */
+    AsyncServer(boost::asio::io_service& service, int port);
+
+    /** Runs the server forever.
+
+        \param[in] numThreads The number of threads running the
+        io_service.  If zero, one thread per core is used.
+    */
+    void run(int numThreads);
+
+private:
+    /** Starts an asynchronous accept for the next client. */
+    void accept();
+
+    /** The I/O service used for all operations. */
+    boost::asio::io_service& service;
+
+    /** The server socket that accepts connections. */
+    boost::asio::ip::tcp::acceptor acceptor;
+
+    /** Reaps the commands run by all the connections. */
+    ChildReaper reaper;
+};
+
+#endif
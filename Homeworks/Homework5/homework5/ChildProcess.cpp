@@ -10,13 +10,17 @@
 
 // All the necessary #includes are already here
 #include <unistd.h>
+#include <fcntl.h>
 #include <sys/wait.h>
+#include <cerrno>
+#include <csignal>
 #include <stdexcept>
 #include <vector>
 #include <sstream>
 #include <iomanip>
 #include <string>
 #include "ChildProcess.h"
+#include "CmdSpawner.h"
 
 // Named-constants to keep pipe code readable below
 const int READ = 0, WRITE = 1;
@@ -90,13 +94,44 @@ ChildProcess::forkNexec(const StrVec& argList) {
 }
 
 // Use the comments in the header to implement the wait method.  This
-// is a relatively simple method which uses waitpid call to get
-// exitCode as shown in Slide #6 of ForkAndExec.pdf
+// is a relatively simple method which uses wait4 call to get
+// exitCode (as with waitpid in Slide #6 of ForkAndExec.pdf) along
+// with the resources used by the child.
 int
-ChildProcess::wait() const {
+ChildProcess::wait() {
+    reap(0);  // wait for child to finish
+    return stats.status;
+}
+
+bool
+ChildProcess::tryWait() {
+    return reap(WNOHANG);
+}
+
+bool
+ChildProcess::reap(int options) {
+    if (childPid <= 0) {
+        return true;  // No child (or already reaped).
+    }
     int exitCode = 0;  // Child process's exit code
-    waitpid(childPid, &exitCode, 0);  // wait for child to finish
-    return exitCode;
+    struct rusage usage = {};
+    const int pid = wait4(childPid, &exitCode, options, &usage);
+    if (pid == 0 || (pid == -1 && errno == EINTR)) {
+        return false;  // Child is still running.
+    }
+    auto seconds = [](const timeval& tv) {
+        return tv.tv_sec + tv.tv_usec / 1e6;
+    };
+    stats.status     = exitCode;
+    stats.wallSec    = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - startTime).count();
+    stats.userSec    = seconds(usage.ru_utime);
+    stats.sysSec     = seconds(usage.ru_stime);
+    stats.maxRssKb   = usage.ru_maxrss;
+    stats.volCtxSw   = usage.ru_nvcsw;
+    stats.involCtxSw = usage.ru_nivcsw;
+    childPid = -1;
+    return true;
 }
 
 // Method to first redirect output of child process via a pipe. Then
@@ -105,16 +140,38 @@ ChildProcess::wait() const {
 // the childProcess stream.
 int
 ChildProcess::forkNexecIO(const StrVec& argList) {
+    // Have the pre-forked helper (if running) create the child so
+    // that the cost does not grow with the size of this process.
+    using Clock = std::chrono::steady_clock;
+    stats     = ChildStats();
+    startTime = Clock::now();
+    auto spawnTime = [this] {
+        return std::chrono::duration<double, std::micro>(
+            Clock::now() - startTime).count();
+    };
+    int outFd = -1;
+    childPid = CmdSpawner::instance().spawn(argList, outFd);
+    if (childPid != -1) {
+        stats.spawnUsec = spawnTime();
+        pipeBuf = {outFd, std::ios::in, sizeof(char)};
+        return childPid;
+    }
+
     int pipefd[2];  // The pipe file descriptors
-    pipe(pipefd);   // Make system call to get pipe file descriptors
+    // Make system call to get pipe file descriptors.  The descriptors
+    // are close-on-exec so that children forked concurrently (by
+    // other threads) do not inherit them and hold the pipe open.
+    pipe2(pipefd, O_CLOEXEC);
 
     // Fork and save the pid of the child process.
     childPid = fork();
+    stats.spawnUsec = spawnTime();
 
     // Appropriately tie the I/O streams of the parent and child processes.
     if (childPid == 0) {
         // In the child process
         close(pipefd[READ]);     // Close unused end (in child)
+        signal(SIGPIPE, SIG_DFL);  // The server ignores SIGPIPE.
         dup2(pipefd[WRITE], 1);  // Tie/redirect std::cout of command
         myExec(argList);         // Run a different program
     }
@@ -9,7 +9,9 @@
  * Copyright (C) 2020 raodm@miamiOH.edu
  */
 
+#include <sys/resource.h>
 #include <ext/stdio_filebuf.h>
+#include <chrono>
 #include <iostream>
 #include <string>
 #include <vector>
@@ -17,6 +19,32 @@
 // A convenience shortcut to a vector-of-strings
 using StrVec = std::vector<std::string>;
 
+/**
+ * The resource usage and timing of a child process.  The values are
+ * filled in when the child is reaped (using wait4).
+ */
+struct ChildStats {
+    /** The exit status of the child (as returned by waitpid). */
+    int status = 0;
+    /** Time (in microseconds) taken to create the child and start
+        the program.  With the CmdSpawner helper this is until the
+        program was exec'd; otherwise it is until fork returned. */
+    double spawnUsec = 0;
+    /** Time (in seconds) from the start of the spawn until the child
+        was reaped. */
+    double wallSec = 0;
+    /** CPU time (in seconds) used by the child in user mode. */
+    double userSec = 0;
+    /** CPU time (in seconds) used by the child in the kernel. */
+    double sysSec = 0;
+    /** Peak resident set size (memory) of the child in kilobytes. */
+    long maxRssKb = 0;
+    /** Context switches because the child waited (e.g., for I/O). */
+    long volCtxSw = 0;
+    /** Context switches because the child was preempted. */
+    long involCtxSw = 0;
+};
+
 // ------------------------------------------------------------------- //
 // ****  NOTE: NEVER NEVER put "using namespace" IN A HEADER FILE  *** //
 // ------------------------------------------------------------------- //
@@ -57,8 +85,9 @@ public:
     
     /**
      * This method creates an process with output of child process
-     * redirected using a pipe.
-     *
+     * redirected using a pipe.  If the CmdSpawner helper is running
+     * the process is created by the helper (which is much smaller
+     * than the server).  Otherwise this process forks directly.
      *
      * \param[in] argList The list of command-line arguments.  The
      *   first entry is assumed to be the command to be executed. 
@@ -81,14 +110,29 @@ public:
     int forkNexec(const StrVec& argList);
 
     /** Helper method to wait for child process to finish.  This
-        method calls the waitpid system call. It obtains the exit code
-        of the child process from the 2nd argument of the waitpid
-        system call.
+        method calls the wait4 system call. It obtains the exit code
+        of the child process from the 2nd argument of the wait4
+        system call and its resource usage from the 4th argument.
 
         \return This method returns the exit code of the child
         process.
     */
-    int wait() const;
+    int wait();
+
+    /** Reaps the child if it has finished, without blocking.  This
+        is used by event-driven code that must never block on a
+        child.  The exit code and resource usage are then available
+        via getStats.
+
+        \return True if the child has been reaped (or there is no
+        child), false if the child is still running.
+    */
+    bool tryWait();
+
+    /** Returns the resource usage and timing of the child.  Only the
+        spawn time is valid until the child has been reaped by
+        wait. */
+    const ChildStats& getStats() const { return stats; }
 
     /**
      * Get the stream from where the child-process's outputs can be
@@ -103,6 +147,26 @@ public:
      * be read.
      */
     std::istream& getChildOutput() { return childOutput; }
+
+    /**
+     * Get the file descriptor of the pipe from where the
+     * child-process's outputs can be read.  This is useful for
+     * asynchronous I/O.  The descriptor is owned by this object and
+     * is closed when this object is destroyed.
+     *
+     * \note First call forkNexecIO() before using this descriptor.
+     *
+     * \return The read-end of the pipe connected to the child's
+     * standard output.
+     */
+    int getChildOutputFd() { return pipeBuf.fd(); }
+
+    /**
+     * Closes the read-end of the pipe connected to the child's
+     * standard output.  A child that is still writing then gets
+     * SIGPIPE instead of blocking forever on a full pipe.
+     */
+    void closeChildOutput() { pipeBuf.close(); }
     
 protected:
     /** A helper method to setup pointers and call execvp system call.
@@ -116,13 +180,26 @@ protected:
     */
     void myExec(StrVec argList);
 
+    /** Helper for wait and tryWait that calls wait4 with the given
+        options and records the exit code and resource usage.
+
+        \return True if the child was reaped.
+    */
+    bool reap(int options);
+
 private:
-    /** The only instance variable in this class.  It is initialized
-        to -1 in the constructor.  The value is changed by the
-        forkNexec method.
+    /** The pid of the child process.  It is initialized to -1 in the
+        constructor.  The value is changed by the forkNexec method.
     */
     int childPid;
 
+    /** The time at which the child was started, to compute the wall
+        clock time of the child. */
+    std::chrono::steady_clock::time_point startTime;
+
+    /** The resource usage and timing of the child. */
+    ChildStats stats;
+
     /**
      * A wrapper class that is needed to convert a pipe handle (which
      * is an integer) to an std::istream so that we can conveniently
@@ -0,0 +1,160 @@
+#ifndef CMD_SPAWNER_CPP
+#define CMD_SPAWNER_CPP
+
+/**
+ * Implementation of the pre-forked helper that spawns commands.
+ *
+ * File:   CmdSpawner.cpp
+ * Author: Kyle Lierer
+ *
+ * Copyright (C) 2020 liererkt@miamioh.edu
+ */
+
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "CmdSpawner.h"
+
+/** The largest request (all the arguments of a command) accepted. */
+const size_t MaxRequestSize = 65536;
+
+/**
+ * Helper method to send a pid along with a file descriptor (using
+ * SCM_RIGHTS) over a UNIX domain socket.
+ *
+ * \param[in] sock The socket to write to.
+ *
+ * \param[in] pid The pid to be sent.
+ *
+ * \param[in] fd The descriptor to be passed.  -1 to send just the pid.
+ */
+static void sendPid(int sock, int pid, int fd) {
+    iovec iov = {&pid, sizeof(pid)};
+    char ctrl[CMSG_SPACE(sizeof(int))] = {};
+    msghdr msg = {};
+    msg.msg_iov    = &iov;
+    msg.msg_iovlen = 1;
+    if (fd != -1) {
+        msg.msg_control    = ctrl;
+        msg.msg_controllen = sizeof(ctrl);
+        cmsghdr *cmsg    = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type  = SCM_RIGHTS;
+        cmsg->cmsg_len   = CMSG_LEN(sizeof(int));
+        std::memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+    }
+    sendmsg(sock, &msg, MSG_NOSIGNAL);
+}
+
+CmdSpawner&
+CmdSpawner::instance() {
+    static CmdSpawner spawner;
+    return spawner;
+}
+
+bool
+CmdSpawner::start() {
+    // Sequenced packets keep each request and reply as one message.
+    int fds[2];
+    if (sock != -1 ||
+        socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, fds) == -1) {
+        return sock != -1;
+    }
+    const int pid = fork();
+    if (pid == 0) {
+        close(fds[0]);
+        serve(fds[1]);
+    }
+    close(fds[1]);
+    if (pid == -1) {
+        close(fds[0]);
+        return false;
+    }
+    sock = fds[0];
+    return true;
+}
+
+void
+CmdSpawner::serve(int sock) {
+    std::vector<char> buf(MaxRequestSize);
+    while (true) {
+        // Each request is a list of '\0'-terminated arguments.
+        const ssize_t len = recv(sock, buf.data(), buf.size(), MSG_TRUNC);
+        if (len <= 0) {
+            _exit(0);  // The server has exited.
+        }
+        int pipefd[2];
+        if (len > ssize_t(buf.size()) || buf[len - 1] != '\0' ||
+            pipe2(pipefd, O_CLOEXEC) == -1) {
+            sendPid(sock, -1, -1);  // Let the server fork instead.
+            continue;
+        }
+        std::vector<char*> args;  // Pointers to the arguments in buf
+        for (ssize_t i = 0; i < len; i += strlen(&buf[i]) + 1) {
+            args.push_back(&buf[i]);
+        }
+        args.push_back(nullptr);  // nullptr is very important
+        // Create the command as a child of the server (our parent) so
+        // that the server can wait for it.  CLONE_VFORK suspends us
+        // until the command has been exec'd, so the reply tells the
+        // server that the program has started.
+        const int pid = syscall(SYS_clone,
+                                CLONE_PARENT | CLONE_VFORK | SIGCHLD,
+                                nullptr, nullptr, nullptr, nullptr);
+        if (pid == 0) {
+            dup2(pipefd[1], 1);  // Tie/redirect std::cout of command
+            execvp(args[0], args.data());
+            const std::string msg = "Call to execvp failed for: " +
+                std::string(args[0]) + "\n";
+            write(2, msg.data(), msg.size());
+            _exit(127);
+        }
+        close(pipefd[1]);
+        sendPid(sock, pid, (pid == -1 ? -1 : pipefd[0]));
+        close(pipefd[0]);
+    }
+}
+
+int
+CmdSpawner::spawn(const StrVec& argList, int& outFd) {
+    if (sock == -1 || argList.empty()) {
+        return -1;
+    }
+    std::string req;
+    for (const auto& arg : argList) {
+        req.append(arg.c_str(), arg.size() + 1);  // Include the '\0'.
+    }
+    if (req.size() > MaxRequestSize) {
+        return -1;
+    }
+    int pid = -1;
+    iovec iov = {&pid, sizeof(pid)};
+    char ctrl[CMSG_SPACE(sizeof(int))];
+    msghdr msg = {};
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = ctrl;
+    msg.msg_controllen = sizeof(ctrl);
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+        if (send(sock, req.data(), req.size(), MSG_NOSIGNAL) !=
+            static_cast<ssize_t>(req.size()) ||
+            recvmsg(sock, &msg, MSG_CMSG_CLOEXEC) != sizeof(pid)) {
+            return -1;  // The helper has died.
+        }
+    }
+    cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    if (pid == -1 || cmsg == nullptr || cmsg->cmsg_type != SCM_RIGHTS) {
+        return -1;
+    }
+    std::memcpy(&outFd, CMSG_DATA(cmsg), sizeof(int));
+    return pid;
+}
+
+#endif
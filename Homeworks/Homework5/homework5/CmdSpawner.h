@@ -0,0 +1,68 @@
+#ifndef CMD_SPAWNER_H
+#define CMD_SPAWNER_H
+
+/**
+ * A small pre-forked helper process (a "zygote") that spawns commands
+ * on behalf of the server.  The helper is forked when the server
+ * starts (while the server is still small) and receives commands over
+ * a UNIX domain socket.  The cost of forking a command then does not
+ * grow with the memory used by the server (e.g., the AssetCache).
+ *
+ * File:   CmdSpawner.h
+ * Author: Kyle Lierer
+ *
+ * Copyright (C) 2020 liererkt@miamioh.edu
+ */
+
+#include <mutex>
+#include "ChildProcess.h"
+
+/**
+ * The server side of the zygote.  Commands are spawned with
+ * clone(CLONE_PARENT) so that they are children of the server (and
+ * not of the helper) and hence can be waited for as usual using
+ * waitpid.  The read-end of the pipe connected to the command's
+ * standard output is passed back to the server using SCM_RIGHTS.
+ */
+class CmdSpawner {
+public:
+    /** The process-wide spawner used by ChildProcess::forkNexecIO. */
+    static CmdSpawner& instance();
+
+    /**
+     * Forks the helper process.  This method must be called early,
+     * before the server starts any threads or allocates much memory.
+     *
+     * \return True if the helper process is running.
+     */
+    bool start();
+
+    /**
+     * Has the helper process run a command with its standard output
+     * redirected to a pipe.  This method is thread-safe.
+     *
+     * \param[in] argList The list of command-line arguments.  The
+     * first entry is assumed to be the command to be executed.
+     *
+     * \param[out] outFd The read-end of the pipe connected to the
+     * command's output.  The descriptor is close-on-exec.
+     *
+     * \return The pid of the command.  This method returns -1 if the
+     * helper is not running or could not run the command, in which
+     * case the caller should fork the command itself.
+     */
+    int spawn(const StrVec& argList, int& outFd);
+
+private:
+    /** The main loop of the helper process.  It never returns. */
+    static void serve(int sock);
+
+    /** The socket connected to the helper.  -1 if not running. */
+    int sock = -1;
+
+    /** Requests are sent one at a time so that each thread receives
+        the reply to its own request. */
+    std::mutex mutex;
+};
+
+#endif
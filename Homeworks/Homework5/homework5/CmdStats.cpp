@@ -0,0 +1,78 @@
+#ifndef CMD_STATS_CPP
+#define CMD_STATS_CPP
+
+/**
+ * Implementation of the table of resources used by commands.
+ *
+ * File:   CmdStats.cpp
+ * Author: Kyle Lierer
+ *
+ * Copyright (C) 2020 liererkt@miamioh.edu
+ */
+
+#include <boost/format.hpp>
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+#include "AssetCache.h"
+#include "CmdStats.h"
+
+CmdStats&
+CmdStats::instance() {
+    static CmdStats stats;
+    return stats;
+}
+
+void
+CmdStats::record(const std::string& program, const ChildStats& stats) {
+    std::lock_guard<std::mutex> guard(mutex);
+    Totals& total = totals[program];
+    total.runs++;
+    total.failures   += (stats.status != 0);
+    total.spawnUsec  += stats.spawnUsec;
+    total.wallSec    += stats.wallSec;
+    total.userSec    += stats.userSec;
+    total.sysSec     += stats.sysSec;
+    total.maxRssKb    = std::max(total.maxRssKb, stats.maxRssKb);
+    total.volCtxSw   += stats.volCtxSw;
+    total.involCtxSw += stats.involCtxSw;
+}
+
+std::string
+CmdStats::report() const {
+    // Copy the totals so that the lock is not held while formatting.
+    std::vector<std::pair<std::string, Totals>> rows;
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+        rows.assign(totals.begin(), totals.end());
+    }
+    std::sort(rows.begin(), rows.end(), [](const auto& a, const auto& b) {
+        return a.second.userSec + a.second.sysSec >
+            b.second.userSec + b.second.sysSec;
+    });
+    const std::string row = "%-16s %6s %6s %9s %9s %9s %10s %10s %9s %9s\n";
+    std::string text = (boost::format(row) % "program" % "runs" % "fails" %
+                        "user(s)" % "sys(s)" % "wall(s)" % "spawn(us)" %
+                        "maxRSS(KB)" % "vcsw" % "ivcsw").str();
+    for (const auto& entry : rows) {
+        const Totals& t = entry.second;
+        text += (boost::format("%-16s %6d %6d %9.3f %9.3f %9.3f %10.0f "
+                               "%10d %9d %9d\n") % entry.first % t.runs %
+                 t.failures % t.userSec % t.sysSec % t.wallSec %
+                 (t.spawnUsec / t.runs) % t.maxRssKb % t.volCtxSw %
+                 t.involCtxSw).str();
+    }
+    return text;
+}
+
+void
+CmdStats::prepare(http::response& resp, bool keepAlive) const {
+    resp.body    = report() + '\n' + http::AssetCache::instance().report();
+    resp.headers = http::StaticHttpHeaders +
+        "Content-Length: " + std::to_string(resp.body.size()) + "\r\n"
+        "Content-Type: text/plain\r\n"
+        "Cache-Control: no-store\r\n" + http::getConnectionHeader(keepAlive);
+}
+
+#endif
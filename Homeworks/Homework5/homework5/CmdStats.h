@@ -0,0 +1,90 @@
+#ifndef CMD_STATS_H
+#define CMD_STATS_H
+
+/**
+ * Process-wide totals of the resources used by the commands run via
+ * "cgi-bin/exec", grouped by program, so that the commands that
+ * dominate the cost of the server can be identified.  The totals are
+ * reported by the (optional) "/stats" URL, followed by the counters
+ * of the static file cache (see http::AssetCache).
+ *
+ * File:   CmdStats.h
+ * Author: Kyle Lierer
+ *
+ * Copyright (C) 2020 liererkt@miamioh.edu
+ */
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "ChildProcess.h"
+#include "HTTPFile.h"
+
+/**
+ * A thread-safe table of the resources used by each program.  Every
+ * command that is reaped is recorded, whether or not the "/stats"
+ * URL is enabled.
+ */
+class CmdStats {
+public:
+    /** The process-wide table used by the server. */
+    static CmdStats& instance();
+
+    /**
+     * Adds the resources used by a command to the totals for its
+     * program.
+     *
+     * \param[in] program The program that was run (the first word of
+     * the command).
+     *
+     * \param[in] stats The statistics of the child that ran the
+     * command (after it was reaped).
+     */
+    void record(const std::string& program, const ChildStats& stats);
+
+    /**
+     * Returns a plain-text table of the totals for each program, with
+     * the programs that used the most CPU time first.  The spawn
+     * time is the average per run and the RSS is the largest.
+     */
+    std::string report() const;
+
+    /**
+     * Sets up the response to a "/stats" request.
+     *
+     * \param[out] resp The response with the report as its body.
+     *
+     * \param[in] keepAlive If true the response indicates that the
+     * connection is kept open.
+     */
+    void prepare(http::response& resp, bool keepAlive) const;
+
+    /** Enables or disables the "/stats" URL.  It is disabled by
+        default so that the file named "stats" (if any) is served. */
+    void setEnabled(bool enable) { enabled = enable; }
+
+    /** Returns true if the "/stats" URL is enabled. */
+    bool isEnabled() const { return enabled; }
+
+private:
+    /** The totals for one program. */
+    struct Totals {
+        size_t runs     = 0;  ///< Number of times the program was run
+        size_t failures = 0;  ///< Runs with a non-zero exit status
+        double spawnUsec = 0, wallSec = 0, userSec = 0, sysSec = 0;
+        long maxRssKb = 0;    ///< The largest peak RSS of any run
+        long volCtxSw = 0, involCtxSw = 0;
+    };
+
+    /** The mutex to guard the totals. */
+    mutable std::mutex mutex;
+
+    /** The totals indexed by program. */
+    std::unordered_map<std::string, Totals> totals;
+
+    /** Whether the "/stats" URL is enabled. */
+    std::atomic<bool> enabled{false};
+};
+
+#endif
@@ -7,15 +7,32 @@
  *
  * Copyright (C) 2020 raodm@miamioh.edu
  */
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <zlib.h>
+#include <cerrno>
+#include <ctime>
+#include <sstream>
 #include <string>
 #include <iostream>
 #include <fstream>
+#include <algorithm>
+#include <vector>
 #include "HTTPFile.h"
 
+/** The size of the blocks in which files are read and chunked */
+const size_t BlockSize = 65536;
+
 // Convenience method to determine the content-type of a given file.
 std::string http::getContentType(const std::string& path) {
     // Extract the extension from the path.
-    const std::string ext = path.substr(path.rfind('.'));
+    const size_t dotPos = path.rfind('.');
+    const std::string ext = (dotPos == std::string::npos ? "" :
+                             path.substr(dotPos));
     // Return suitable content types for the different types that we know.
     if (ext == ".html") {
         return "text/html";
@@ -32,10 +49,58 @@ std::string http::getContentType(const std::string& path) {
     return "text/plain";
 }
 
+// Convenience method to determine if a file compresses well.
+bool http::isCompressible(const std::string& path) {
+    const size_t dotPos = path.rfind('.');
+    const std::string ext = (dotPos == std::string::npos ? "" :
+                             path.substr(dotPos));
+    return ext == ".html" || ext == ".htm" || ext == ".css" ||
+        ext == ".js" || ext == ".txt" || ext == ".json" || ext == ".xml" ||
+        ext == ".svg" || ext == ".csv";
+}
+
+// Choose the content coding for the file based on the request.
+std::string http::negotiateEncoding(const std::string& path,
+                                    const request& req) {
+    if (!isCompressible(path)) {
+        return "";
+    } else if (req.acceptsEncoding("gzip")) {
+        return "gzip";
+    } else if (req.acceptsEncoding("deflate")) {
+        return "deflate";
+    }
+    return "";
+}
+
+// Compress the data in one shot (the data is small enough to cache).
+bool http::compress(const std::string& data, const std::string& encoding,
+                    std::string& out) {
+    if (encoding != "gzip" && encoding != "deflate") {
+        return false;
+    }
+    // Adding 16 to the window bits selects the gzip format.
+    const int windowBits = (encoding == "gzip" ? MAX_WBITS + 16 : MAX_WBITS);
+    z_stream zs = {};
+    if (deflateInit2(&zs, Z_BEST_COMPRESSION, Z_DEFLATED, windowBits, 8,
+                     Z_DEFAULT_STRATEGY) != Z_OK) {
+        return false;
+    }
+    // The result is cached, so spend the time for the best compression.
+    out.resize(deflateBound(&zs, data.size()));
+    zs.next_in   = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+    zs.avail_in  = data.size();
+    zs.next_out  = reinterpret_cast<Bytef*>(&out[0]);
+    zs.avail_out = out.size();
+    const bool done = (deflate(&zs, Z_FINISH) == Z_STREAM_END);
+    out.resize(zs.total_out);
+    deflateEnd(&zs);
+    return done;
+}
+
 // The operator that HTTP-streams the file if valid or sends a 404 error.
 std::ostream& http::operator<<(std::ostream& os, const http::file& file) {
     // First open the data file and if the stream is not good return 404
-    std::ifstream data(file.path);
+    std::ifstream data(file.path, std::ios::binary);
     if (!data.good()) {
         // The file name is invalid. Send HTTP 404 error message.
         const std::string msg = "File not found: " + file.path;
@@ -45,14 +110,13 @@ std::ostream& http::operator<<(std::ostream& os, const http::file& file) {
         // The file is valid. Let's send the 200 header and stream the
         // contents of the file to the client.
         os << file.headers << http::getContentType(file.path) << "\r\n\r\n";
-        // Now stream the contents out.
-        for (std::string line; std::getline(data, line);) {
-            // Note that std::getline() consumes/removes '\n'. So,
-            // below we add the '\n' back because that was actually
-            // present in the original data and it must be included.
-            line += '\n';
-            // Write the line of data as an HTTP-chunk
-            os << std::hex << line.size() << "\r\n" << line << "\r\n";
+        // Now stream the contents out in large blocks. Blocks are
+        // read as-is so that binary files are sent unmodified.
+        std::vector<char> buf(BlockSize);
+        while (data.read(buf.data(), buf.size()) || data.gcount() > 0) {
+            // Write the block of data as an HTTP-chunk
+            os << std::hex << data.gcount() << "\r\n";
+            os.write(buf.data(), data.gcount()) << "\r\n";
         }
     }
     // Finally send the trailing "0" chunk to finish the HTTP-response.
@@ -61,4 +125,361 @@ std::ostream& http::operator<<(std::ostream& os, const http::file& file) {
     return os;
 }
 
+// Close the file (if any) associated with the response.
+http::response::~response() {
+    if (fd != -1) {
+        close(fd);
+    }
+}
+
+// Return the in-memory parts of the response in the order to be sent.
+std::vector<iovec> http::response::buffers() const {
+    // Helper lambda to create an iovec for a part of a string.
+    auto part = [](const std::string& str, size_t start, size_t end) {
+        return iovec{const_cast<char*>(str.data() + start), end - start};
+    };
+    if (asset != nullptr) {
+        // Cached headers, then Connection header, then cached body.
+        return {part(asset->data, 0, asset->bodyOffset),
+                part(headers, 0, headers.size()),
+                part(asset->data, asset->bodyOffset, asset->data.size())};
+    }
+    return {part(headers, 0, headers.size()), part(body, 0, body.size())};
+}
+
+// Open the file and setup headers with the size of the file.
+void http::file::prepare(http::response& resp) const {
+    // Small files (and their compressed variants) are served from
+    // memory.
+    resp.asset = AssetCache::instance().get(path, encoding);
+    if (resp.asset != nullptr) {
+        const asset& entry = *resp.asset;
+        if (!prepareConditional(resp, entry.etag, entry.lastModified,
+                                entry.mtime.tv_sec,
+                                entry.data.size() - entry.bodyOffset,
+                                entry.encoding)) {
+            resp.headers = getConnectionHeader(keepAlive);
+        }
+        return;
+    }
+    struct stat info;
+    resp.fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (resp.fd == -1 || fstat(resp.fd, &info) == -1 ||
+        !S_ISREG(info.st_mode)) {
+        // The file name is invalid. Setup HTTP 404 error message.
+        if (resp.fd != -1) {
+            close(resp.fd);
+            resp.fd = -1;
+        }
+        resp.body = "File not found: " + path;
+        resp.headers = "HTTP/1.1 404 Not Found\r\n"
+            "Content-Length: " + std::to_string(resp.body.size()) + "\r\n"
+            "Content-Type: text/plain\r\n" + getConnectionHeader(keepAlive);
+        return;
+    }
+    // Large files are not compressed on the fly, but an up-to-date
+    // precompressed sibling (e.g., "big.txt.gz") is sent instead.
+    struct stat gzInfo;
+    std::string bodyEncoding;
+    size_t size = info.st_size;
+    if (encoding == "gzip") {
+        const int gzFd = open((path + ".gz").c_str(), O_RDONLY | O_CLOEXEC);
+        if (gzFd != -1 && fstat(gzFd, &gzInfo) == 0 &&
+            S_ISREG(gzInfo.st_mode) && gzInfo.st_mtime >= info.st_mtime) {
+            close(resp.fd);
+            resp.fd = gzFd;
+            size = gzInfo.st_size;
+            bodyEncoding = encoding;
+        } else if (gzFd != -1) {
+            close(gzFd);
+        }
+    }
+    // The file is valid. The body will be sent straight from the file.
+    resp.offset    = 0;
+    resp.remaining = size;
+    const std::string etag = getETag(info, bodyEncoding);
+    const std::string lastModified = toHttpDate(info.st_mtime);
+    if (!prepareConditional(resp, etag, lastModified, info.st_mtime, size,
+                            bodyEncoding)) {
+        resp.headers = getStaticHeaders(path, size, bodyEncoding,
+                                        getValidators(etag, lastModified)) +
+            getConnectionHeader(keepAlive);
+    }
+}
+
+/**
+ * Helper method to check if an If-None-Match header lists an entity
+ * tag.  Weak tags (e.g., W/"xyz") match their strong counterparts, as
+ * required for If-None-Match.
+ *
+ * \param[in] tags The value of the If-None-Match header.
+ *
+ * \param[in] etag The current entity tag of the file.
+ *
+ * \return True if the header matches the entity tag.
+ */
+static bool matchesETag(const std::string& tags, const std::string& etag) {
+    std::istringstream list(tags);
+    for (std::string tag; std::getline(list, tag, ',');) {
+        tag.erase(0, tag.find_first_not_of(" \t"));
+        tag.erase(tag.find_last_not_of(" \t") + 1);
+        if (tag.compare(0, 2, "W/") == 0) {
+            tag.erase(0, 2);
+        }
+        if (tag == "*" || tag == etag) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Helper method to parse a date in a HTTP header.
+ *
+ * \param[in] date The date, e.g., "Sun, 06 Nov 1994 08:49:37 GMT".
+ *
+ * \return The date as a time_t.  -1 if the date is invalid.
+ */
+static time_t fromHttpDate(const std::string& date) {
+    struct tm tm = {};
+    if (strptime(date.c_str(), "%a, %d %b %Y %H:%M:%S GMT", &tm) == nullptr) {
+        return -1;
+    }
+    return timegm(&tm);
+}
+
+/**
+ * Helper method to build the headers that describe the body of a
+ * file (regardless of whether all or a part of it is sent).
+ *
+ * \param[in] path The path to the file.
+ *
+ * \param[in] encoding The content coding of the body, if any.
+ *
+ * \param[in] validators The ETag and Last-Modified headers, if any.
+ *
+ * \return The headers, each ending with "\r\n".
+ */
+static std::string getEntityHeaders(const std::string& path,
+                                    const std::string& encoding,
+                                    const std::string& validators) {
+    std::string headers = "Content-Type: " + http::getContentType(path) +
+        "\r\n";
+    if (!encoding.empty()) {
+        headers += "Content-Encoding: " + encoding + "\r\n";
+    }
+    // Tell caches that the body depends on the client's encodings.
+    if (http::isCompressible(path)) {
+        headers += "Vary: Accept-Encoding\r\n";
+    }
+    return headers + validators + "Accept-Ranges: bytes\r\n";
+}
+
+int http::file::checkConditions(const std::string& etag, time_t mtime,
+                                size_t size, size_t& start,
+                                size_t& len) const {
+    // If-None-Match takes precedence over If-Modified-Since.
+    if (!ifNoneMatch.empty()) {
+        if (matchesETag(ifNoneMatch, etag)) {
+            return 304;
+        }
+    } else if (!ifModifiedSince.empty()) {
+        const time_t since = fromHttpDate(ifModifiedSince);
+        if (since != -1 && mtime <= since) {
+            return 304;
+        }
+    }
+    start = 0;
+    len   = size;
+    // The range is ignored (and the whole file sent) if the file has
+    // changed since the client got the first part (If-Range).
+    if (range.compare(0, 6, "bytes=") != 0 ||
+        (!ifRange.empty() && ifRange != etag &&
+         ifRange != toHttpDate(mtime))) {
+        return 200;
+    }
+    // Only a single range is supported. Multiple ranges (which need a
+    // multipart response) get the whole file, as HTTP allows. The ','
+    // separating multiple ranges is rejected below.
+    const std::string spec = range.substr(6);
+    const size_t dash = spec.find('-');
+    if (dash == std::string::npos || spec.size() > 32 ||
+        spec.find('-', dash + 1) != std::string::npos ||
+        spec.find_first_not_of("0123456789-") != std::string::npos) {
+        return 200;
+    }
+    const std::string first = spec.substr(0, dash);
+    const std::string last  = spec.substr(dash + 1);
+    if (first.size() > 18 || last.size() > 18) {
+        return 200;  // Too large to be a valid offset.
+    }
+    if (first.empty()) {
+        // Suffix range, e.g. "bytes=-500" for the last 500 bytes.
+        if (last.empty() || std::stoull(last) == 0) {
+            return (last.empty() ? 200 : 416);
+        }
+        len   = std::min<size_t>(std::stoull(last), size);
+        start = size - len;
+        return (size == 0 ? 416 : 206);
+    }
+    start = std::stoull(first);
+    if (start >= size) {
+        return 416;
+    }
+    const size_t end = (last.empty() ? size - 1 :
+                        std::min<size_t>(std::stoull(last), size - 1));
+    if (end < start) {
+        return 200;  // Invalid range. Ignore it.
+    }
+    len = end - start + 1;
+    return 206;
+}
+
+bool http::file::prepareConditional(response& resp, const std::string& etag,
+                                    const std::string& lastModified,
+                                    time_t mtime, size_t size,
+                                    const std::string& bodyEncoding) const {
+    size_t start = 0, len = size;
+    const int status = checkConditions(etag, mtime, size, start, len);
+    if (status == 200) {
+        return false;
+    }
+    const std::string validators = getValidators(etag, lastModified);
+    if (status == 206) {
+        resp.headers = Http206Headers + "Content-Length: " +
+            std::to_string(len) + "\r\nContent-Range: bytes " +
+            std::to_string(start) + "-" + std::to_string(start + len - 1) +
+            "/" + std::to_string(size) + "\r\n" +
+            getEntityHeaders(path, bodyEncoding, validators);
+        if (resp.asset != nullptr) {
+            resp.body = resp.asset->data.substr(resp.asset->bodyOffset +
+                                                start, len);
+        } else {
+            resp.offset    = start;
+            resp.remaining = len;
+        }
+    } else {
+        // No body for 304 (the client's copy is current) or 416.
+        resp.headers = (status == 304 ? Http304Headers + validators :
+                        Http416Headers + "Content-Range: bytes */" +
+                        std::to_string(size) + "\r\nContent-Length: 0\r\n");
+        resp.remaining = 0;
+    }
+    resp.asset = nullptr;
+    resp.headers += getConnectionHeader(keepAlive);
+    return true;
+}
+
+// Build the Connection header that ends the headers.
+std::string http::getConnectionHeader(bool keepAlive) {
+    return (keepAlive ? "Connection: keep-alive\r\n\r\n" :
+            "Connection: Close\r\n\r\n");
+}
+
+// Build the headers for sending a file with a Content-Length.
+std::string http::getStaticHeaders(const std::string& path, size_t length,
+                                   const std::string& encoding,
+                                   const std::string& validators) {
+    return StaticHttpHeaders + "Content-Length: " + std::to_string(length) +
+        "\r\n" + getEntityHeaders(path, encoding, validators);
+}
+
+// Build an entity tag from the inode, size, and modification time.
+std::string http::getETag(const struct stat& info,
+                          const std::string& encoding) {
+    std::ostringstream etag;
+    etag << '"' << std::hex << info.st_ino << '-' << info.st_size << '-'
+         << info.st_mtim.tv_sec << '.' << info.st_mtim.tv_nsec
+         << (encoding.empty() ? "" : "-") << encoding << '"';
+    return etag.str();
+}
+
+// Format a time as a HTTP date.
+std::string http::toHttpDate(time_t time) {
+    struct tm tm;
+    char date[64];
+    gmtime_r(&time, &tm);
+    strftime(date, sizeof(date), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    return date;
+}
+
+// Build the headers used to revalidate a cached copy of a file.
+std::string http::getValidators(const std::string& etag,
+                                const std::string& lastModified) {
+    return "ETag: " + etag + "\r\nLast-Modified: " + lastModified + "\r\n";
+}
+
+/**
+ * Helper method to wait for a non-blocking socket to become writable
+ * after a write returned EAGAIN.  Sockets used by tcp::iostream are
+ * internally in non-blocking mode.
+ *
+ * \param[in] sockFd The socket to wait on.
+ *
+ * \param[in] result The value returned by the write call.
+ *
+ * \return True if the write should be retried.
+ */
+static bool waitWritable(int sockFd, ssize_t result) {
+    if (result == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+        return false;  // Client disconnected or other error.
+    }
+    pollfd pfd = {sockFd, POLLOUT, 0};
+    return poll(&pfd, 1, -1) == 1;
+}
+
+bool http::sendAll(int sockFd, std::vector<iovec> parts, int flags) {
+    msghdr msg = {};
+    msg.msg_iov    = parts.data();
+    msg.msg_iovlen = parts.size();
+    while (true) {
+        // Skip over the parts that have been completely sent.
+        while (msg.msg_iovlen > 0 && msg.msg_iov->iov_len == 0) {
+            msg.msg_iov++;
+            msg.msg_iovlen--;
+        }
+        if (msg.msg_iovlen == 0) {
+            return true;
+        }
+        // A client that disconnected must not kill the server.
+        ssize_t n = sendmsg(sockFd, &msg, flags | MSG_NOSIGNAL);
+        if (n <= 0) {
+            if (!waitWritable(sockFd, n)) {
+                return false;
+            }
+            continue;
+        }
+        // Advance past the bytes that were sent.
+        for (iovec* part = msg.msg_iov; n > 0; part++) {
+            const size_t len = std::min<size_t>(n, part->iov_len);
+            part->iov_base = static_cast<char*>(part->iov_base) + len;
+            part->iov_len -= len;
+            n -= len;
+        }
+    }
+}
+
+// Send the file to the socket using sendfile.
+bool http::file::send(int sockFd) const {
+    response resp;
+    prepare(resp);
+    // Send the in-memory parts in one system call. MSG_MORE lets the
+    // kernel merge the headers with the first segment of the file.
+    const int flags = (resp.remaining > 0 ? MSG_MORE : 0);
+    if (!sendAll(sockFd, resp.buffers(), flags)) {
+        return false;
+    }
+    // Have the kernel copy the file's pages directly to the socket.
+    while (resp.remaining > 0) {
+        const ssize_t n = sendfile(sockFd, resp.fd, &resp.offset,
+                                   resp.remaining);
+        if (n > 0) {
+            resp.remaining -= n;
+        } else if (!waitWritable(sockFd, n)) {
+            return false;
+        }
+    }
+    return true;
+}
+
 # endif
@@ -7,8 +7,14 @@
  *
  * Copyright (C) 2020 raodm@miamioh.edu
  */
+#include <sys/types.h>
+#include <sys/stat.h>
 #include <string>
+#include <sys/uio.h>
 #include <iostream>
+#include <vector>
+#include "AssetCache.h"
+#include "HTTPRequest.h"
 
 /** A HTTP namespace to disambiguate the file class encapsulated by
     it.
@@ -36,6 +42,113 @@ namespace http {
         "Transfer-Encoding: chunked\r\n"
         "Connection: Close\r\n\r\n";
 
+    /**
+     * The HTTP headers used when a file is sent as a single body with
+     * a Content-Length (instead of chunks).  The Content-Length,
+     * Content-Type, and Connection headers are appended to these
+     * headers.
+     */
+    const std::string StaticHttpHeaders =
+        "HTTP/1.1 200 OK\r\n";
+
+    /**
+     * The status line sent when the client's cached copy of a file
+     * (identified by If-None-Match or If-Modified-Since) is current.
+     * The response has no body.
+     */
+    const std::string Http304Headers =
+        "HTTP/1.1 304 Not Modified\r\n";
+
+    /**
+     * The status line sent with a part of a file that was requested
+     * using a Range header.
+     */
+    const std::string Http206Headers =
+        "HTTP/1.1 206 Partial Content\r\n";
+
+    /**
+     * The status line sent if the requested range is beyond the end
+     * of the file.
+     */
+    const std::string Http416Headers =
+        "HTTP/1.1 416 Range Not Satisfiable\r\n";
+
+    /**
+     * A HTTP response to a file request that is ready to be sent.
+     * The complete response is either a cached asset, or the body is
+     * held in memory (e.g., for 404 errors), or the body is sent
+     * straight from an open file descriptor using sendfile.
+     */
+    class response {
+    public:
+        /** The default constructor creates an empty response. */
+        response() = default;
+
+        /** The destructor closes the file descriptor (if any). */
+        ~response();
+
+        // Responses own a file descriptor and cannot be copied.
+        response(const response&) = delete;
+        response& operator=(const response&) = delete;
+
+        /**
+         * Returns the parts of the response held in memory, in the
+         * order in which they are to be sent.  The contents of fd (if
+         * any) are to be sent after these parts.  The buffers refer
+         * to data in this object.
+         *
+         * \return Up to 3 buffers that can be written with writev.
+         */
+        std::vector<iovec> buffers() const;
+
+        /** The cached headers and body of the file.  If this is set
+            then the cached headers are sent, followed by headers
+            below, followed by the cached body. */
+        AssetPtr asset;
+
+        /** The status line and all the headers (including the blank
+            line at the end of the headers).  For cached files these
+            are just the headers that vary from request to request. */
+        std::string headers;
+
+        /** The body of the response if it is not sent from fd. */
+        std::string body;
+
+        /** Open file whose contents form the body. -1 if not used. */
+        int fd = -1;
+
+        /** Offset in fd from where the next byte is to be sent. */
+        off_t offset = 0;
+
+        /** Number of bytes from fd that are yet to be sent. */
+        size_t remaining = 0;
+    };
+
+    /**
+     * Determines if a file is worth compressing (e.g., HTML, CSS, or
+     * JavaScript) based on the file's extension.  Images are already
+     * compressed and are sent as-is.
+     *
+     * \param[in] path The path to the file.
+     *
+     * \return True if the file is a text file that compresses well.
+     */
+    bool isCompressible(const std::string& path);
+
+    /**
+     * Chooses the content coding for sending a file to a client.
+     * gzip is preferred over deflate.
+     *
+     * \param[in] path The path to the file to be sent.
+     *
+     * \param[in] req The request with the client's Accept-Encoding.
+     *
+     * \return "gzip", "deflate", or an empty string if the file is
+     * to be sent uncompressed.
+     */
+    std::string negotiateEncoding(const std::string& path,
+                                  const request& req);
+
     /** Convenience wrapper class to stream path to a given file as a
         HTTP response.
     */
@@ -61,6 +174,57 @@ namespace http {
              const std::string& headers = DefaultHttpHeaders) :
             path(path), headers(headers) {}
 
+        /** Constructor used to respond to a specific request.  The
+            headers in the request are used to tailor the response
+            (e.g., to keep the connection alive).
+
+            \param[in] path The path to the file to be sent.
+
+            \param[in] req The request from the client.
+
+            \param[in] keepAlive If true, the connection is kept open
+            for further requests (if the client wants it).
+        */
+        file(const std::string& path, const request& req, bool keepAlive) :
+            path(path), headers(DefaultHttpHeaders),
+            keepAlive(keepAlive && req.keepAlive()),
+            encoding(negotiateEncoding(path, req)),
+            ifNoneMatch(req.header("if-none-match")),
+            ifModifiedSince(req.header("if-modified-since")),
+            range(req.header("range")), ifRange(req.header("if-range")) {}
+
+        /**
+         * Sets up the response from the process-wide AssetCache if
+         * the file is small enough to be cached.  Otherwise opens the
+         * file and sets up the response with the headers (including
+         * Content-Length) and the file descriptor from where the body
+         * is to be sent.  If the file is not a valid regular file
+         * then a 404 response is setup instead.  If the client
+         * accepts a compressed encoding, the compressed variant of
+         * the file (a precompressed ".gz" sibling or a cached copy
+         * compressed on the fly) is sent instead.  Conditional
+         * requests for a current copy get a 304 response and
+         * requests with a (single) byte Range get a 206 response
+         * with just that part of the file.
+         *
+         * \param[out] resp The response to be setup by this method.
+         */
+        void prepare(response& resp) const;
+
+        /**
+         * Sends the file to a socket without copying its contents
+         * through user space.  The body is sent using sendfile and
+         * framed using a Content-Length header, so binary files are
+         * sent unmodified.
+         *
+         * \param[in] sockFd The socket to which the response is to be
+         * written.  If the socket is non-blocking, this method waits
+         * (using poll) for the socket to become writable.
+         *
+         * \return True if the complete response was sent.
+         */
+        bool send(int sockFd) const;
+
     private:
         /**
          * Path to the file to be streamed out by this class. This
@@ -74,6 +238,61 @@ namespace http {
          * changed.
          */        
         std::string headers;
+
+        /** Whether the response keeps the connection open. */
+        bool keepAlive = false;
+
+        /** The content coding ("gzip", "deflate", or "" for none)
+            negotiated with the client. */
+        std::string encoding;
+
+        /** The conditional and range headers from the request. */
+        std::string ifNoneMatch, ifModifiedSince, range, ifRange;
+
+        /**
+         * Evaluates the conditional and range headers in the request
+         * against the current version of the file.
+         *
+         * \param[in] etag The entity tag of the file's body.
+         *
+         * \param[in] mtime The last modification time of the file.
+         *
+         * \param[in] size The size of the file's body.
+         *
+         * \param[out] start The offset of the first byte to be sent.
+         *
+         * \param[out] len The number of bytes to be sent.
+         *
+         * \return The HTTP status code for the response: 200, 206,
+         * 304, or 416.
+         */
+        int checkConditions(const std::string& etag, time_t mtime,
+                            size_t size, size_t& start, size_t& len) const;
+
+        /**
+         * Sets up a 304, 206, or 416 response if the request calls
+         * for one.  The body of a 206 response is a part of the
+         * cached body (if resp.asset is set) or of resp.fd.
+         *
+         * \param[in,out] resp The response with the complete file.
+         *
+         * \param[in] etag The entity tag of the file's body.
+         *
+         * \param[in] lastModified The Last-Modified date of the file.
+         *
+         * \param[in] mtime The last modification time of the file.
+         *
+         * \param[in] size The size of the file's body.
+         *
+         * \param[in] bodyEncoding The content coding of the body.
+         *
+         * \return True if the response was changed.  False if the
+         * complete file is to be sent with a 200 response.
+         */
+        bool prepareConditional(response& resp, const std::string& etag,
+                                const std::string& lastModified,
+                                time_t mtime, size_t size,
+                                const std::string& bodyEncoding) const;
     };
 
     /**
@@ -90,6 +309,109 @@ namespace http {
      */
     std::string getContentType(const std::string& path);
 
+    /**
+     * Compresses data for a given content coding using zlib.
+     *
+     * \param[in] data The data to be compressed.
+     *
+     * \param[in] encoding The content coding, "gzip" or "deflate"
+     * (i.e., the zlib format).
+     *
+     * \param[out] out The compressed data.
+     *
+     * \return True if the data was compressed.
+     */
+    bool compress(const std::string& data, const std::string& encoding,
+                  std::string& out);
+
+    /**
+     * Returns the HTTP Connection header followed by the blank line
+     * that ends the headers.
+     *
+     * \param[in] keepAlive If true the header indicates that the
+     * connection is kept open. Otherwise it indicates it is closed.
+     *
+     * \return The Connection header and the blank line.
+     */
+    std::string getConnectionHeader(bool keepAlive);
+
+    /**
+     * Returns the HTTP status line and headers (excluding the
+     * Connection header and the blank line at the end) for sending a
+     * file with a Content-Length.
+     *
+     * \param[in] path The path to the file, used to determine the
+     * content type.
+     *
+     * \param[in] length The size of the body in bytes.
+     *
+     * \param[in] encoding The content coding of the body, if any.
+     *
+     * \param[in] validators The ETag and Last-Modified headers (from
+     * getValidators), if any.
+     *
+     * \return The HTTP headers for sending the file.
+     */
+    std::string getStaticHeaders(const std::string& path, size_t length,
+                                 const std::string& encoding = "",
+                                 const std::string& validators = "");
+
+    /**
+     * Returns the entity tag for a version of a file.  The tag is
+     * derived from the file's inode, size, and modification time, so
+     * it changes whenever the file is modified.  Each content coding
+     * of the file has a different tag.
+     *
+     * \param[in] info The status (from stat) of the file.
+     *
+     * \param[in] encoding The content coding of the body, if any.
+     *
+     * \return The entity tag, including the double quotes.
+     */
+    std::string getETag(const struct stat& info,
+                        const std::string& encoding = "");
+
+    /**
+     * Converts a time to the format used in HTTP headers, e.g.,
+     * "Sun, 06 Nov 1994 08:49:37 GMT".
+     *
+     * \param[in] time The time to be converted.
+     *
+     * \return The time as a string.
+     */
+    std::string toHttpDate(time_t time);
+
+    /**
+     * Returns the ETag and Last-Modified headers that let clients
+     * revalidate their cached copy of a file.
+     *
+     * \param[in] etag The entity tag (from getETag).
+     *
+     * \param[in] lastModified The modification time (from
+     * toHttpDate).
+     *
+     * \return The headers, each ending with "\r\n".
+     */
+    std::string getValidators(const std::string& etag,
+                              const std::string& lastModified);
+
+    /**
+     * Sends a list of buffers to a socket using as few system calls
+     * as possible (scatter-gather I/O).  Partial writes are resumed
+     * and, for non-blocking sockets, this method waits for the socket
+     * to become writable as needed.
+     *
+     * \param[in] sockFd The socket to write to.
+     *
+     * \param[in] parts The list of buffers to be sent.
+     *
+     * \param[in] flags The flags for the sendmsg system call.
+     * MSG_NOSIGNAL is always added.
+     *
+     * \return True if all the data was sent.
+     */
+    bool sendAll(int sockFd, std::vector<iovec> parts, int flags = 0);
+
     /** Prototype for operator<< used for HTTP-streaming file contents */
     std::ostream& operator<<(std::ostream& os, const file& file);
     
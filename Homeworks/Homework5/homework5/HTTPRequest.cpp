@@ -0,0 +1,135 @@
+#ifndef HTTP_REQUEST_CPP
+#define HTTP_REQUEST_CPP
+
+/**
+ * Implementation of the class to read HTTP requests.
+ *
+ * File:   HTTPRequest.cpp
+ * Author: Kyle Lierer
+ *
+ * Copyright (C) 2020 liererkt@miamioh.edu
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include "HTTPRequest.h"
+
+/**
+ * Helper method to convert a string to lower case.
+ *
+ * \param[in] str The string to be converted.
+ *
+ * \return The string in lower case.
+ */
+static std::string toLower(std::string str) {
+    std::transform(str.begin(), str.end(), str.begin(), ::tolower);
+    return str;
+}
+
+std::string
+http::request::header(const std::string& name) const {
+    const auto entry = headers.find(name);
+    return (entry != headers.end() ? entry->second : "");
+}
+
+bool
+http::request::keepAlive() const {
+    const std::string conn = toLower(header("connection"));
+    if (version == "HTTP/1.0") {
+        return conn == "keep-alive";
+    }
+    return conn != "close";
+}
+
+bool
+http::request::acceptsEncoding(const std::string& coding) const {
+    // The header is a list such as "gzip, deflate;q=0.5, br".
+    std::istringstream codings(toLower(header("accept-encoding")));
+    bool wildcard = false;
+    for (std::string item; std::getline(codings, item, ',');) {
+        const size_t start = item.find_first_not_of(" \t");
+        const size_t end   = item.find_first_of(" \t;", start);
+        if (start == std::string::npos) {
+            continue;
+        }
+        const std::string name = item.substr(start, end - start);
+        // An optional quality value follows the name, e.g. ";q=0".
+        const size_t qPos = item.find("q=", end);
+        const bool ok = (qPos == std::string::npos ||
+                         std::atof(item.c_str() + qPos + 2) > 0);
+        if (name == coding) {
+            return ok;
+        } else if (name == "*") {
+            wildcard = ok;
+        }
+    }
+    return wildcard;
+}
+
+bool
+http::request::contentLength(size_t& len) const {
+    len = 0;
+    const std::string value = header("content-length");
+    if (value.empty()) {
+        return true;
+    }
+    // The value comes from the client, so it is checked strictly
+    // instead of letting std::stoul throw on bad input.
+    if (value.find_first_not_of("0123456789") != std::string::npos) {
+        return false;
+    }
+    char *end = nullptr;
+    errno = 0;
+    const unsigned long long num = std::strtoull(value.c_str(), &end, 10);
+    if (errno == ERANGE || *end != '\0' || num > MaxContentLength) {
+        return false;
+    }
+    len = num;
+    return true;
+}
+
+std::istream&
+http::operator>>(std::istream& is, http::request& req) {
+    req.method.clear();
+    req.path.clear();
+    req.version.clear();
+    req.headers.clear();
+    // Read the request line, e.g., "GET /index.html HTTP/1.1".  Empty
+    // lines before it are skipped (as allowed by RFC 7230 3.5).
+    std::string line;
+    while (std::getline(is, line) && (line.empty() || line == "\r")) {}
+    if (!is) {
+        return is;
+    }
+    std::istringstream words(line);
+    std::string extra;
+    if (!(words >> req.method >> req.path >> req.version) ||
+        (words >> extra)) {
+        is.setstate(std::ios::failbit);  // Not "method target version".
+        return is;
+    }
+    // Read headers until the blank line. Lines may end with "\r\n".
+    while (std::getline(is, line) && !line.empty() && line != "\r") {
+        if (line.back() == '\r') {
+            line.pop_back();
+        }
+        const size_t colon = line.find(':');
+        if (colon == std::string::npos) {
+            continue;  // Ignore malformed header.
+        }
+        const size_t valPos = line.find_first_not_of(" \t", colon + 1);
+        req.headers[toLower(line.substr(0, colon))] =
+            (valPos == std::string::npos ? "" : line.substr(valPos));
+    }
+    // Input that ends without the blank line (e.g., a test file) is
+    // still a request.
+    if (is.eof()) {
+        is.clear(std::ios::eofbit);
+    }
+    return is;
+}
+
+#endif
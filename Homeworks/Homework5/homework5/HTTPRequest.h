@@ -0,0 +1,104 @@
+#ifndef HTTP_REQUEST_H
+#define HTTP_REQUEST_H
+
+/**
+ * A simple class to read the request line and headers of a HTTP
+ * request from a given input stream.  The request is framed exactly
+ * (up to the blank line after the headers) so that several requests
+ * can be read, one after another, from a persistent connection.
+ *
+ * File:   HTTPRequest.h
+ * Author: Kyle Lierer
+ *
+ * Copyright (C) 2020 liererkt@miamioh.edu
+ */
+
+#include <iostream>
+#include <string>
+#include <unordered_map>
+
+namespace http {
+    /** Shortcut to a map of HTTP headers. The names of the headers
+        are stored in lower case (e.g., "connection"). */
+    using HeaderMap = std::unordered_map<std::string, std::string>;
+
+    /** The largest request body that is accepted (and skipped). */
+    const size_t MaxContentLength = 64 * 1024 * 1024;
+
+    /** A HTTP request read from a client. */
+    class request {
+    public:
+        // Stream extraction operator to read a request.
+        friend std::istream& operator>>(std::istream& is, request& req);
+
+        /**
+         * Returns the value of a given header.
+         *
+         * \param[in] name The name of the header in lower case.
+         *
+         * \return The value of the header.  An empty string is
+         * returned if the header is not present.
+         */
+        std::string header(const std::string& name) const;
+
+        /**
+         * Determines if the client wants the connection to be kept
+         * open for further requests.  HTTP/1.1 connections are
+         * persistent unless the client sends "Connection: close".
+         * HTTP/1.0 connections are persistent only if the client
+         * sends "Connection: keep-alive".
+         */
+        bool keepAlive() const;
+
+        /**
+         * Determines if the client accepts a given content coding
+         * based on the Accept-Encoding header.  Codings listed with
+         * a quality value of zero (e.g., "gzip;q=0") are not
+         * accepted.
+         *
+         * \param[in] coding The content coding in lower case, e.g.,
+         * "gzip".
+         *
+         * \return True if the coding is listed (explicitly or via
+         * "*") in the Accept-Encoding header.
+         */
+        bool acceptsEncoding(const std::string& coding) const;
+
+        /**
+         * Obtains the number of bytes in the body that follows the
+         * headers (from the Content-Length header).
+         *
+         * \param[out] len The length of the body.  Zero if the header
+         * is not present.
+         *
+         * \return False if the header is not a plain decimal number
+         * or exceeds MaxContentLength.  Such a request cannot be
+         * framed and the connection should be closed.
+         */
+        bool contentLength(size_t& len) const;
+
+        /** The method in the request, e.g. "GET". */
+        std::string method;
+
+        /** The target in the request, e.g. "/index.html". */
+        std::string path;
+
+        /** The version in the request, e.g. "HTTP/1.1". */
+        std::string version;
+
+        /** The headers in the request. */
+        HeaderMap headers;
+    };
+
+    /**
+     * Reads the request line and the headers (up to and including the
+     * blank line after the headers) from the given stream.  Empty
+     * lines before the request line are skipped.  The body (if any)
+     * is not read.  The stream is put in a failed state if a request
+     * could not be read: with eof set if the stream ended, or without
+     * it if the request line does not consist of exactly three words.
+     */
+    std::istream& operator>>(std::istream& is, request& req);
+}  // namespace http
+
+#endif
@@ -9,29 +9,49 @@
  * 
  */
 
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
 #include <boost/asio.hpp>
+#include <algorithm>
+#include <csignal>
+#include <cstdlib>
+#include <sstream>
 #include <string>
+#include <vector>
+#include "liererkt_hw5.h"
 #include "HTTPFile.h"
 #include "ChildProcess.h"
+#include "HTTPRequest.h"
+#include "AsyncServer.h"
+#include "CmdSpawner.h"
+#include "CmdStats.h"
 
 // Convenience namespace to streamline the code below.
 using namespace boost::asio;
 using namespace boost::asio::ip;
 
-/** The HTTP response header to be printed at the beginning of the
-    response */
-const std::string HTTPHeaders =
-    "HTTP/1.1 200 OK\r\n"
-    "Transfer-Encoding: chunked\r\n"
-    "Connection: Close\r\n"
-    "Content-Type: text/plain\r\n"
-    "\r\n";
-
-// Forward declaration for url_decode method defined below.  We need
-// this declaration this just to organize the starter code into
-// sections that students should not modify (to minimize problems for
-// students).
-std::string url_decode(std::string url);
+/** How long the serial server waits for the next request on a
+    persistent connection.  Other clients wait while a connection is
+    idle, so this is kept short. */
+const std::chrono::milliseconds SerialIdleTimeout(200);
+
+/** The largest chunk of command output sent to a socket at once. */
+const size_t MaxChunkSize = 64 * 1024;
+
+/** How long command output is held back so that it can be combined
+    with further output into one chunk.  This bounds the latency seen
+    by clients of interactive commands. */
+const std::chrono::milliseconds FlushDelay(5);
+
+/** The amount of pending command output at which the output is
+    spliced from the pipe to the socket instead of being copied. */
+const int SpliceThreshold = 16 * 1024;
+
+/** The requested capacity of the pipe from a command so that large
+    amounts of output can be spliced at once. */
+const int CmdPipeSize = 1 << 20;
 
 /**
  * The method that runs a command and prints its output in HTTP
@@ -42,15 +62,19 @@ std::string url_decode(std::string url);
  *
  * \param[in] cmd The command to be run by this method using methods
  * in ChildProcess class.
+ *
+ * \param[in] keepAlive If true, the response indicates that the
+ * connection is kept open for further requests.
  */
-void sendCmdOutput(std::ostream& os, const std::string& cmd) {
+void sendCmdOutput(std::ostream& os, const std::string& cmd,
+                   bool keepAlive) {
     // Split the command into individual words
     const StrVec& args = ChildProcess::split(cmd);
     // Create a child process to run the command
     ChildProcess cp;
     cp.forkNexecIO(args);
     // Prints HTTP header.
-    os << HTTPHeaders;
+    os << (keepAlive ? KeepAliveHTTPHeaders : HTTPHeaders);
     // Now print the output of the program line-by-line to the given
     // output stream.
     std::istream& progOutStream = cp.getChildOutput();
@@ -59,6 +83,187 @@ void sendCmdOutput(std::ostream& os, const std::string& cmd) {
         os << std::hex << line.size() << "\r\n" << line << "\r\n";
     }
     os << "0\r\n\r\n";
+    cp.wait();
+    if (!args.empty()) {
+        CmdStats::instance().record(args.front(), cp.getStats());
+    }
+}
+
+/**
+ * Helper method to write a chunk of command output (preceded by any
+ * pending headers) to the socket with one scatter-gather write.
+ *
+ * \param[in] sockFd The socket connected to the client.
+ *
+ * \param[in,out] headers Headers yet to be sent.  Cleared once sent.
+ *
+ * \param[in] data The output to be sent in the chunk.
+ *
+ * \param[in] len The number of bytes of output.  If zero, the last
+ * chunk that ends the response is sent.
+ *
+ * \return True if the data was sent to the client.
+ */
+static bool sendChunk(int sockFd, std::string& headers, char *data,
+                      size_t len) {
+    std::ostringstream hex;
+    hex << std::hex << len << "\r\n";
+    const std::string chunkHdr = hex.str();
+    char chunkEnd[] = "\r\n";
+    const std::vector<iovec> parts = {
+        {&headers[0], headers.size()},
+        {const_cast<char*>(chunkHdr.data()), chunkHdr.size()},
+        {data, len}, {chunkEnd, 2}};
+    const bool sent = http::sendAll(sockFd, parts);
+    headers.clear();
+    return sent;
+}
+
+/**
+ * Helper method to send output that is in the pipe as one chunk
+ * using splice so that the data is moved from the pipe to the socket
+ * within the kernel.  If splice is not supported for the socket, the
+ * data is copied instead.
+ *
+ * \param[in] pipeFd The (non-blocking) pipe with the output.
+ *
+ * \param[in] sockFd The socket connected to the client.
+ *
+ * \param[in,out] headers Headers yet to be sent.  Cleared once sent.
+ *
+ * \param[in] len The number of bytes in the pipe to be sent.
+ *
+ * \param[in,out] useSplice Set to false if splice is not supported.
+ *
+ * \return True if the data was sent to the client.
+ */
+static bool spliceChunk(int pipeFd, int sockFd, std::string& headers,
+                        size_t len, bool& useSplice) {
+    std::ostringstream hex;
+    hex << std::hex << len << "\r\n";
+    std::string head = headers + hex.str();
+    headers.clear();
+    if (!http::sendAll(sockFd, {{&head[0], head.size()}}, MSG_MORE)) {
+        return false;
+    }
+    char copyBuf[4096];
+    while (len > 0) {
+        ssize_t n = -1;
+        if (useSplice) {
+            n = splice(pipeFd, nullptr, sockFd, nullptr, len,
+                       SPLICE_F_MOVE | SPLICE_F_MORE | SPLICE_F_NONBLOCK);
+            if (n == -1 && (errno == EINVAL || errno == ENOSYS)) {
+                useSplice = false;  // Copy the rest of the data.
+                continue;
+            }
+        } else {
+            n = read(pipeFd, copyBuf, std::min(len, sizeof(copyBuf)));
+            if (n > 0 && !http::sendAll(sockFd, {{copyBuf, size_t(n)}})) {
+                return false;
+            }
+        }
+        if (n > 0) {
+            len -= n;
+        } else if (n == -1 && errno == EAGAIN) {
+            // The socket's buffer is full (the data is in the pipe).
+            pollfd pfd = {sockFd, POLLOUT, 0};
+            poll(&pfd, 1, -1);
+        } else {
+            return false;  // Client disconnected.
+        }
+    }
+    char chunkEnd[] = "\r\n";
+    return http::sendAll(sockFd, {{chunkEnd, 2}});
+}
+
+bool sendCmdOutput(int sockFd, const std::string& cmd, bool keepAlive) {
+    using Clock = std::chrono::steady_clock;
+    // Split the command into individual words
+    const StrVec& args = ChildProcess::split(cmd);
+    // Create a child process to run the command
+    ChildProcess cp;
+    cp.forkNexecIO(args);
+    // Read the pipe without blocking so that output can be gathered
+    // until the buffer is full or the flush delay expires.
+    const int pipeFd = cp.getChildOutputFd();
+    fcntl(pipeFd, F_SETFL, fcntl(pipeFd, F_GETFL) | O_NONBLOCK);
+    fcntl(pipeFd, F_SETPIPE_SZ, CmdPipeSize);  // Best effort.
+    // The headers go out along with the first chunk.
+    std::string headers = (keepAlive ? KeepAliveHTTPHeaders : HTTPHeaders);
+    std::vector<char> buf(MaxChunkSize);
+    size_t used = 0;
+    Clock::time_point deadline;
+    bool eof = false, sent = true, useSplice = true;
+    while (!eof) {
+        // Wait for more output, but not past the deadline for data
+        // that is already buffered.
+        int timeout = -1;
+        if (used > 0) {
+            const auto left = std::chrono::duration_cast<
+                std::chrono::milliseconds>(deadline - Clock::now());
+            timeout = std::max<int>(0, left.count());
+        }
+        pollfd pfd = {pipeFd, POLLIN, 0};
+        if (poll(&pfd, 1, timeout) == 1) {
+            int avail = 0;
+            if (used == 0 && useSplice && sent &&
+                ioctl(pipeFd, FIONREAD, &avail) == 0 &&
+                avail >= SpliceThreshold) {
+                // Bulk output. Move it to the socket without copying.
+                sent = spliceChunk(pipeFd, sockFd, headers, avail,
+                                   useSplice);
+                continue;
+            }
+            const ssize_t n = read(pipeFd, &buf[used], buf.size() - used);
+            if (n > 0) {
+                if (used == 0) {
+                    deadline = Clock::now() + FlushDelay;
+                }
+                used += n;
+            } else if (n == 0 || (errno != EAGAIN && errno != EINTR)) {
+                eof = true;
+            }
+        }
+        if (used > 0 && (used == buf.size() || eof ||
+                         Clock::now() >= deadline)) {
+            // Once the client is gone, output is still drained (and
+            // discarded) so that the child does not block on the pipe.
+            sent = sent && sendChunk(sockFd, headers, buf.data(), used);
+            used = 0;
+        }
+    }
+    cp.wait();
+    if (!args.empty()) {
+        CmdStats::instance().record(args.front(), cp.getStats());
+    }
+    return sent && sendChunk(sockFd, headers, nullptr, 0);
+}
+
+// Returns the relative URL in the target of a request.
+std::string extractRelUrl(const std::string& target) {
+    // Gets the relative url.
+    std::string relUrl = target;
+
+    // Remove the leading backslash if one is present.
+    size_t blackslashPos = relUrl.find('/');
+    if (blackslashPos != std::string::npos) {
+       relUrl = relUrl.erase(blackslashPos, blackslashPos + 1);
+    }
+    return relUrl;
+}
+
+// Extracts the command to be run if the relative URL is an exec request.
+bool getCommand(const std::string& relUrl, std::string& cmd) {
+    // The string leading before a command.
+    const std::string cmdLeadingStr = "cgi-bin/exec?cmd=";
+
+    // Finds the leading string for a command.
+    size_t leadingStrPos = relUrl.find(cmdLeadingStr);
+    if (leadingStrPos == std::string::npos) {
+        return false;
+    }
+    cmd = url_decode(relUrl.substr(leadingStrPos + cmdLeadingStr.length()));
+    return true;
 }
 
 /**
@@ -79,35 +284,137 @@ void sendCmdOutput(std::ostream& os, const std::string& cmd) {
  *
  * @param os The output stream to send chunked HTTP response data back
  * to the client (or web-browser).
+ *
+ * @param sockFd The socket underlying os, if any.  When valid, files
+ * are sent directly from the kernel to the socket using sendfile and
+ * command output is streamed to the socket in large chunks.
+ *
+ * @param persist If true, the connection is kept open after the
+ * response if the client wants it.
+ *
+ * @return True if the connection is to be kept open for the next
+ * request.
  */
-void serveClient(std::istream& is, std::ostream& os) {
-    // The string leading before a command.
-    const std::string cmdLeadingStr = "cgi-bin/exec?cmd=";
-        
-    // Gets the relative url.
-    std::string relUrl;
-    is >> relUrl >> relUrl;
-
-    // Remove the leading backslash if one is present.
-    size_t blackslashPos = relUrl.find('/');
-    if (blackslashPos != std::string::npos) {   
-       relUrl = relUrl.erase(blackslashPos, blackslashPos + 1);
+bool serveClient(std::istream& is, std::ostream& os, int sockFd,
+                 bool persist) {
+    // Read the request line and headers and skip any body so that the
+    // next request on a persistent connection is read correctly.
+    http::request req;
+    size_t bodyLen = 0;
+    if (!(is >> req) && is.eof()) {
+        return false;  // The client closed the connection.
     }
-    
-    // Finds the leading string for a command.
-    size_t leadingStrPos = relUrl.find(cmdLeadingStr);
-    
-    // If a leading string for a command is present
-    // execute the trailing command.
-    if (leadingStrPos != std::string::npos) {
-        relUrl = relUrl.substr(leadingStrPos + cmdLeadingStr.length());
-        sendCmdOutput(os, url_decode(relUrl));
-    
-    // If the leading string for a command is not present,
-    // open a file instead of executing a command.
+    if (!is || !req.contentLength(bodyLen)) {
+        // The request cannot be framed, so the connection is unusable.
+        is.clear();  // is and os may be the same stream.
+        os << BadRequestResponse << std::flush;
+        return false;
+    }
+    // Skip the body with read() because ignore() waits for the byte
+    // after the body, which may never arrive on a socket.
+    char skip[4096];
+    while (bodyLen > 0 && is.read(skip, std::min(bodyLen, sizeof(skip)))) {
+        bodyLen -= is.gcount();
+    }
+    const bool keepAlive = persist && req.keepAlive();
+    const std::string relUrl = extractRelUrl(req.path);
+
+    // If the URL is a command, execute it. Otherwise, open a file
+    // instead of executing a command.
+    std::string cmd;
+    if (relUrl == "stats" && CmdStats::instance().isEnabled()) {
+        http::response resp;
+        CmdStats::instance().prepare(resp, keepAlive);
+        if (sockFd == -1) {
+            os << resp.headers << resp.body;
+        } else {
+            os.flush();
+            return http::sendAll(sockFd, resp.buffers()) && keepAlive;
+        }
+    } else if (getCommand(relUrl, cmd)) {
+        if (sockFd == -1) {
+            sendCmdOutput(os, cmd, keepAlive);
+        } else {
+            // Streaming path: large reads written directly to socket.
+            os.flush();
+            return sendCmdOutput(sockFd, cmd, keepAlive) && keepAlive;
+        }
+    } else if (sockFd != -1) {
+        // Zero-copy path: bypass the stream and write to the socket.
+        os.flush();
+        return http::file(relUrl, req, keepAlive).send(sockFd) && keepAlive;
     } else {
         os << http::file(relUrl);
     }
+    return keepAlive;
+}
+
+
+/**
+ * Processes the requests on a client connection accepted by the
+ * serial server (runServer) until the client closes the connection,
+ * asks to close it, or stays idle for SerialIdleTimeout.
+ *
+ * @param client The connection to the client.
+ */
+void serveConnection(tcp::iostream& client) {
+    // Send responses right away instead of waiting for the client to
+    // acknowledge earlier responses on persistent connections.
+    client.socket().set_option(tcp::no_delay(true));
+    for (bool first = true; client.good(); first = false) {
+        if (!first) {
+            // Wait (for a short while) for the next request.
+            client.expires_after(SerialIdleTimeout);
+            if (client.peek() == EOF) {
+                break;
+            }
+            // Responses (e.g., command output) may take any time.
+            client.expires_at(std::chrono::steady_clock::time_point::max());
+        }
+        const bool keepAlive = serveClient(
+            client, client, client.socket().native_handle(), true);
+        client.flush();
+        if (!keepAlive) {
+            break;
+        }
+    }
+}
+
+// The serial server (starter code) defined further below.
+void runServer(int port);
+
+/**
+ * Starts the helpers used by the server and runs the server.  An
+ * optional second command-line argument runs the server in
+ * asynchronous mode using the given number of threads (zero uses one
+ * thread per core).  If the environment variable HW5_STATS is set,
+ * the resources used by the commands run so far are reported at the
+ * URL "/stats".
+ *
+ * @param port The port number on which the server should listen.
+ *
+ * @param argc The number of command-line arguments.
+ *
+ * @param argv The command-line arguments.
+ */
+void startServer(int port, int argc, char *argv[]) {
+    // Start the helper that runs commands while this process is still
+    // small.
+    CmdSpawner::instance().start();
+    // sendfile and splice (unlike send) cannot be told not to raise
+    // SIGPIPE. A client that resets the connection must only end its
+    // own response (via EPIPE), not the server.  The helper above and
+    // the commands keep the default action (see ChildProcess).
+    signal(SIGPIPE, SIG_IGN);
+    CmdStats::instance().setEnabled(std::getenv("HW5_STATS") != nullptr);
+    if (argc > 2) {
+        // Serve many clients concurrently on a fixed set of threads
+        io_service service;
+        AsyncServer server(service, port);
+        server.run(std::stoi(argv[2]));
+    } else {
+        runServer(port);
+    }
 }
 
 
@@ -141,7 +448,7 @@ void runServer(int port) {
         // a client connects.
         server.accept(*client.rdbuf());
         // Have helper method process the client connection.
-        serveClient(client, client);
+        serveConnection(client);
     }
 }
 
@@ -195,7 +502,7 @@ int main(int argc, char *argv[]) {
     if (arg.find_first_not_of("1234567890") == std::string::npos) {
         // All characters are digits. So we assume this is a port
         // number and run as a standard web-server
-        runServer(std::stoi(arg));
+        startServer(std::stoi(arg), argc, argv);
     } else {
         // In this situation, this program processes inputs from a
         // given data file for testing.  That is, instead of a
@@ -0,0 +1,138 @@
+/*
+ * A simple program to process HTTP requests and
+ * generate responses.
+ *
+ * File:   liererkt_hw5.h
+ * Author: Kyle Lierer
+ *
+ * Copyright (C) 2020 liererkt@miamioh.edu
+ *
+ */
+
+#ifndef LIERERKT_HW5_H
+#define LIERERKT_HW5_H
+
+#include <iostream>
+#include <string>
+
+/** The HTTP response header to be printed at the beginning of the
+    response */
+const std::string HTTPHeaders =
+    "HTTP/1.1 200 OK\r\n"
+    "Transfer-Encoding: chunked\r\n"
+    "Connection: Close\r\n"
+    "Content-Type: text/plain\r\n"
+    "\r\n";
+
+/** The HTTP response header for command output on a persistent
+    connection */
+const std::string KeepAliveHTTPHeaders =
+    "HTTP/1.1 200 OK\r\n"
+    "Transfer-Encoding: chunked\r\n"
+    "Connection: keep-alive\r\n"
+    "Content-Type: text/plain\r\n"
+    "\r\n";
+
+/** The complete HTTP response sent for a request that cannot be
+    processed (e.g., an invalid Content-Length).  The connection is
+    closed after this response. */
+const std::string BadRequestResponse =
+    "HTTP/1.1 400 Bad Request\r\n"
+    "Content-Type: text/plain\r\n"
+    "Content-Length: 12\r\n"
+    "Connection: Close\r\n"
+    "\r\n"
+    "Bad request\n";
+
+/**
+ * The method that runs a command and prints its output in HTTP
+ * Chunked format.
+ *
+ * \param[out] os The output stream to where the chunked HTTP response
+ * is to be written.
+ *
+ * \param[in] cmd The command to be run by this method using methods
+ * in ChildProcess class.
+ *
+ * \param[in] keepAlive If true, the response indicates that the
+ * connection is kept open for further requests.
+ */
+void sendCmdOutput(std::ostream& os, const std::string& cmd,
+                   bool keepAlive = false);
+
+/**
+ * Runs a command and streams its output directly to a socket in HTTP
+ * Chunked format.  Unlike the line-by-line version above, the output
+ * is read from the pipe in large non-blocking reads and combined into
+ * chunks of up to MaxChunkSize bytes.  Buffered output is sent once
+ * the buffer fills up or FlushDelay elapses, whichever comes first,
+ * so that bulk output needs few system calls while interactive
+ * commands still see their output promptly.
+ *
+ * \param[in] sockFd The socket connected to the client.
+ *
+ * \param[in] cmd The command to be run by this method using methods
+ * in ChildProcess class.
+ *
+ * \param[in] keepAlive If true, the response indicates that the
+ * connection is kept open for further requests.
+ *
+ * \return True if the whole response was sent to the client.
+ */
+bool sendCmdOutput(int sockFd, const std::string& cmd, bool keepAlive);
+
+/**
+ * Returns the relative URL in the target of a request with the
+ * leading slash removed (e.g. "index.html" for "/index.html").
+ *
+ * \param[in] target The target in the request line.
+ *
+ * \return The relative URL in the request.
+ */
+std::string extractRelUrl(const std::string& target);
+
+/**
+ * Checks if the relative URL is a program execution request
+ * ("cgi-bin/exec?cmd=...") and if so extracts the decoded command.
+ *
+ * \param[in] relUrl The relative URL returned by extractRelUrl.
+ *
+ * \param[out] cmd The decoded command to be run.  This value is set
+ * only if this method returns true.
+ *
+ * \return True if the relative URL is a command to be executed.
+ */
+bool getCommand(const std::string& relUrl, std::string& cmd);
+
+/**
+ * Process HTTP request (from first line & headers) and provide
+ * suitable HTTP response back to the client.
+ *
+ * @param is The input stream to read HTTP reqeust data from client
+ * (or web-browser).
+ *
+ * @param os The output stream to send chunked HTTP response data back
+ * to the client (or web-browser).
+ *
+ * @param sockFd The socket underlying os, if any.  When valid, files
+ * are sent directly from the kernel to the socket using sendfile and
+ * command output is streamed to the socket in large chunks.
+ *
+ * @param persist If true, the connection is kept open after the
+ * response if the client wants it.
+ *
+ * @return True if the connection is to be kept open for the next
+ * request.
+ */
+bool serveClient(std::istream& is, std::ostream& os, int sockFd = -1,
+                 bool persist = false);
+
+/** Convenience method to decode HTML/URL encoded strings.
+
+    \param[in] str The string to be decoded.
+
+    \return The decoded string.
+*/
+std::string url_decode(std::string str);
+
+#endif /* LIERERKT_HW5_H */
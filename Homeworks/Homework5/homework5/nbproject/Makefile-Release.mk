@@ -35,8 +35,13 @@ OBJECTDIR=${CND_BUILDDIR}/${CND_CONF}/${CND_PLATFORM}
 
 # Object Files
 OBJECTFILES= \
+	${OBJECTDIR}/AssetCache.o \
+	${OBJECTDIR}/AsyncServer.o \
 	${OBJECTDIR}/ChildProcess.o \
+	${OBJECTDIR}/CmdSpawner.o \
+	${OBJECTDIR}/CmdStats.o \
 	${OBJECTDIR}/HTTPFile.o \
+	${OBJECTDIR}/HTTPRequest.o \
 	${OBJECTDIR}/liererkt_hw5.o
 
 
@@ -61,18 +66,43 @@ LDLIBSOPTIONS=
 	"${MAKE}"  -f nbproject/Makefile-${CND_CONF}.mk homework5_opt
 
 homework5_opt: ${OBJECTFILES}
-	${LINK.cc} -o homework5_opt ${OBJECTFILES} ${LDLIBSOPTIONS} -lboost_system -lpthread -lmysqlpp
+	${LINK.cc} -o homework5_opt ${OBJECTFILES} ${LDLIBSOPTIONS} -lboost_system -lpthread -lmysqlpp -lz
+
+${OBJECTDIR}/AssetCache.o: AssetCache.cpp
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -O2 -Wall -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/AssetCache.o AssetCache.cpp
+
+${OBJECTDIR}/AsyncServer.o: AsyncServer.cpp
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -O2 -Wall -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/AsyncServer.o AsyncServer.cpp
 
 ${OBJECTDIR}/ChildProcess.o: ChildProcess.cpp
 	${MKDIR} -p ${OBJECTDIR}
 	${RM} "$@.d"
 	$(COMPILE.cc) -O2 -Wall -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/ChildProcess.o ChildProcess.cpp
 
+${OBJECTDIR}/CmdSpawner.o: CmdSpawner.cpp
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -O2 -Wall -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/CmdSpawner.o CmdSpawner.cpp
+
+${OBJECTDIR}/CmdStats.o: CmdStats.cpp
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -O2 -Wall -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/CmdStats.o CmdStats.cpp
+
 ${OBJECTDIR}/HTTPFile.o: HTTPFile.cpp
 	${MKDIR} -p ${OBJECTDIR}
 	${RM} "$@.d"
 	$(COMPILE.cc) -O2 -Wall -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/HTTPFile.o HTTPFile.cpp
 
+${OBJECTDIR}/HTTPRequest.o: HTTPRequest.cpp
+	${MKDIR} -p ${OBJECTDIR}
+	${RM} "$@.d"
+	$(COMPILE.cc) -O2 -Wall -std=c++14 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/HTTPRequest.o HTTPRequest.cpp
+
 ${OBJECTDIR}/liererkt_hw5.o: liererkt_hw5.cpp
 	${MKDIR} -p ${OBJECTDIR}
 	${RM} "$@.d"
@@ -12,6 +12,11 @@
  */
 
 // All the necessary includes are present
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
 #include <boost/asio.hpp>
 #include <boost/format.hpp>
 #include <iostream>
@@ -22,6 +27,21 @@
 #include <unordered_map>
 #include <mutex>
 #include <iomanip>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <condition_variable>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <stdexcept>
+#include <vector>
 
 // Setup a server socket to accept connections on the socket
 using namespace boost::asio;
@@ -33,27 +53,245 @@ const std::string HTTPRespHeader =
     "HTTP/1.1 200 OK\r\n"
     "Server: BankServer\r\n"
     "Content-Length: %1%\r\n"
-    "Connection: Close\r\n"
+    "Connection: %2%\r\n"
     "Content-Type: text/plain\r\n"
     "\r\n";
 
+/** The response sent (before closing the connection) for a request
+    whose body cannot be skipped */
+const std::string HTTPBadResp =
+    "HTTP/1.1 400 Bad Request\r\n"
+    "Server: BankServer\r\n"
+    "Content-Length: 11\r\n"
+    "Connection: Close\r\n"
+    "Content-Type: text/plain\r\n"
+    "\r\n"
+    "Bad request";
+
+/** How long a persistent connection may stay idle between requests */
+const std::chrono::seconds IdleTimeout(15);
+
+/** The response sent when all the workers are busy and the queue of
+    connections is full */
+const std::string HTTPBusyResp =
+    "HTTP/1.1 503 Service Unavailable\r\n"
+    "Server: BankServer\r\n"
+    "Content-Length: 11\r\n"
+    "Connection: Close\r\n"
+    "Retry-After: 1\r\n"
+    "Content-Type: text/plain\r\n"
+    "\r\n"
+    "Server busy";
+
+/** How long the server waits for the request of a connection that is
+    rejected */
+const std::chrono::milliseconds BusyTimeout(100);
+
 // Forward declaration for method defined further below
 std::string url_decode(std::string);
 
-/*
- * Document this class. Use it for encapsulating all of your data,
- * including a std::mutex to avoid race conditions. No, none of the
- * instance variables should be static.
+/**
+ * An append-only log of the transactions of the bank, so that the
+ * accounts survive a crash.  A transaction is committed (and the
+ * client gets its response) once its record is on disk.  A separate
+ * thread writes the records and syncs the log: the records appended
+ * by concurrent transactions while it waits (for the commit window
+ * and for the previous sync) are synced together (group commit), so
+ * one fsync commits many transactions.
+ *
+ * The log is split into segments (files "log.N" in the log
+ * directory).  Periodically, a snapshot of all the accounts is
+ * written (the file "snapshot") and a new segment is started, so
+ * that older segments can be removed and recovery only replays the
+ * records after the snapshot.  Each record is stored as
+ * "<length>:<data>\n", so that a record that was only partly written
+ * (during a crash) is detected and ignored.
+ */
+class TxnLog {
+public:
+    /**
+     * Creates a log in the given directory.  The log is used only
+     * after recover is called.
+     * @param dir The directory with the log files (must exist).
+     * @param window How long to wait for more records before syncing.
+     * @param snapshotEvery The number of records between snapshots.
+     */
+    TxnLog(const std::string& dir, std::chrono::microseconds window,
+           size_t snapshotEvery);
+
+    /** Syncs the records appended so far and stops the thread. */
+    ~TxnLog();
+
+    // The log owns a thread and a file and cannot be copied.
+    TxnLog(const TxnLog&) = delete;
+    TxnLog& operator=(const TxnLog&) = delete;
+
+    /**
+     * Replays the last snapshot and the records logged after it, and
+     * then starts a new segment for the records to be appended.
+     * @param apply The function called with each record, in order.
+     * Returning false (for an invalid record) stops the replay.
+     */
+    void recover(const std::function<bool(const std::string&)>& apply);
+
+    /**
+     * Adds a record to the log.  Records are written in the order in
+     * which they are appended.
+     * @param record The record (the data of the transaction).
+     * @return The sequence number of the record, for wait.
+     */
+    size_t append(const std::string& record);
+
+    /**
+     * Waits until a record (and those before it) are on disk.
+     * @param seq The sequence number returned by append.
+     */
+    void wait(size_t seq);
+
+    /** Returns true (once) every snapshotEvery records. */
+    bool snapshotDue();
+
+    /**
+     * Syncs the current segment and starts a new one.  The caller
+     * must ensure no records are appended meanwhile.
+     * @return The number of the new segment.
+     */
+    size_t rotate();
+
+    /**
+     * Writes a snapshot (atomically) and then removes the segments
+     * that it makes unnecessary.
+     * @param first The first segment not included in the snapshot.
+     * @param data The record with the state of the bank.
+     */
+    void writeSnapshot(size_t first, const std::string& data);
+
+    /**
+     * Outputs the recovery time and the number of commits, syncs, and
+     * snapshots.
+     * @param os The output stream to where the statistics are written.
+     */
+    void report(std::ostream& os) const;
+
+private:
+    /** Shortcut to the clock used for the statistics. */
+    using Clock = std::chrono::steady_clock;
+
+    /** The method run by the thread: writes and syncs records. */
+    void flush();
+
+    /** Opens (creating or truncating) a segment for appending. */
+    int openSegment(size_t number) const;
+
+    /** Returns the path of a file in the log directory. */
+    std::string path(const std::string& name) const {
+        return dir + "/" + name;
+    }
+
+    /** The log directory, the commit window, and the number of records
+        between snapshots. */
+    const std::string dir;
+    const std::chrono::microseconds window;
+    const size_t snapshotEvery;
+
+    /** The mutex and condition variables guarding the members below:
+        wake signals the thread and flushed signals waiting writers. */
+    mutable std::mutex mutex;
+    std::condition_variable wake, flushed;
+
+    /** The records appended but not yet written. */
+    std::string pending;
+
+    /** The number of records appended and synced. */
+    size_t appended = 0, synced = 0;
+
+    /** The thread is writing records, a segment is being rotated, or
+        the log is being destroyed. */
+    bool flushing = false, rotating = false, stop = false;
+
+    /** The current segment and its file. */
+    size_t segment = 0;
+    int fd = -1;
+
+    /** Statistics for report. */
+    size_t sinceSnapshot = 0, syncs = 0, snapshots = 0, recovered = 0;
+    double recoverySecs = 0;
+    Clock::time_point startTime;
+
+    /** The thread that writes the records (started by recover). */
+    std::thread thread;
+};
+
+/**
+ * The accounts of the bank.  The accounts are split into a fixed
+ * number of shards (by the hash of the account name), each with its
+ * own mutex, so that transactions on accounts in different shards run
+ * in parallel.  Writers (create, credit, debit) lock only the shard
+ * of their account.  Reset locks all the shards (always in the same
+ * order, so it cannot deadlock with another reset) and hence is
+ * atomic.
+ *
+ * Status reads never lock.  Each account is a cell with its balance
+ * in integer cents in a 64-bit atomic (so it is never torn) that is
+ * never moved or freed while the bank exists.  A cell has two
+ * balances: the latest one, which writers use, and the committed one,
+ * which status reads see.  The committed balance is only updated once
+ * the record of the change is on disk, so a status read never reports
+ * a balance that a crash could roll back.  The accounts of a
+ * shard are found via a hash table to which writers only add entries
+ * (publishing them with release stores), so readers can walk it
+ * while a writer changes it.  Reset closes accounts rather than
+ * removing them, and creating a closed account reopens it.
+ *
+ * Balances and amounts are in integer cents, so that they add up
+ * exactly.  A batch of operations locks each shard it uses once.
+ *
+ * If the bank has a transaction log, each change is logged (while the
+ * shards it changes are locked, so that the log has the changes in
+ * the order they were made) and the response is given once the log
+ * is synced and the change is visible to status reads.
  */
 class Bank {
 public:
+    /** An operation in a batch (see applyBatch). */
+    struct Operation {
+        enum class Kind { Create, Credit, Debit, Invalid };
+        Kind kind;
+        std::string account;  ///< The account (or the invalid text)
+        long long cents;      ///< The amount for credits and debits
+    };
+
+    /**
+     * Creates a bank, restoring its accounts from its transaction log.
+     * @param log The transaction log (none if nullptr).
+     */
+    explicit Bank(TxnLog* log = nullptr) : log(log) {
+        if (log != nullptr) {
+            log->recover([this](const std::string& record) {
+                    return replay(record);
+                });
+        }
+        for (auto& shard : shards) {
+            for (auto& acct : shard.accounts) {
+                show(acct);
+            }
+        }
+    }
+
     /**
      * Clears the bank map and outputs a message indicating it has been reset.
      * @param os
      */
     void resetBank(std::ostream& os) {
-        std::lock_guard<std::mutex> guard(mutex);
-        bank.clear();
+        std::vector<std::unique_lock<std::mutex>> locks;
+        for (auto& shard : shards) {
+            locks.emplace_back(shard.mutex);
+        }
+        Changes changed;
+        closeAll(&changed);
+        const size_t seq = logRecord("R", changed);
+        locks.clear();
+        commit(seq, changed);
         os << "All accounts reset";
     }
     
@@ -63,79 +301,616 @@ public:
      * @param os
      */
     void createAcct(const std::string& account, std::ostream& os) {
-        std::lock_guard<std::mutex> guard(mutex);
-        if (bank.find(account) == bank.end()) {
-            bank[account] = 0;
-            os  << "Account " << account << " created";
-        } else {
-            os  << "Account " << account << " already exists";
+        const size_t hash = std::hash<std::string>()(account);
+        Shard& shard = shards[hash % ShardCount];
+        std::string record, msg;
+        Changes changed;
+        size_t seq;
+        {
+            std::lock_guard<std::mutex> guard(shard.mutex);
+            msg = create(shard, hash, account, record, changed);
+            seq = logRecord(record, changed);
         }
+        commit(seq, changed);
+        os << msg;
     }
     
     /**
      * Adds a balance to an account in the bank and outputs a message 
      * indicating the changes.
      * @param account
-     * @param balance
+     * @param cents The amount (in cents) to be added (negative for
+     * debits).
      * @param os
      */
-    void modifyBalance(const std::string& account, const double& balance, 
-                            std::ostream& os) {
-        std::lock_guard<std::mutex> guard(mutex);
-        auto find = bank.find(account);
-        if (find != bank.end()) {
-            find->second += balance;
-            os << "Account balance updated";
-        } else {
-            os << "Account not found";
+    void modifyBalance(const std::string& account, long long cents,
+                       std::ostream& os) {
+        const size_t hash = std::hash<std::string>()(account);
+        Shard& shard = shards[hash % ShardCount];
+        std::string record, msg;
+        Changes changed;
+        size_t seq;
+        {
+            std::lock_guard<std::mutex> guard(shard.mutex);
+            msg = credit(shard, hash, account, cents, record, changed);
+            seq = logRecord(record, changed);
         }
+        commit(seq, changed);
+        os << msg;
+    }
+
+    /**
+     * Applies a batch of operations and outputs the result of each
+     * operation (the message for the single operation) on its own
+     * line.  The shards used by the batch are each locked once (in
+     * the same order as reset) for the whole batch, so the batch is
+     * atomic.  The batch is logged as one record.
+     * @param ops The operations, applied in order.
+     * @param os
+     */
+    void applyBatch(const std::vector<Operation>& ops, std::ostream& os) {
+        std::vector<size_t> hashes;
+        std::array<bool, ShardCount> used{};
+        for (const auto& op : ops) {
+            hashes.push_back(std::hash<std::string>()(op.account));
+            used[hashes.back() % ShardCount] = true;
+        }
+        std::vector<std::unique_lock<std::mutex>> locks;
+        for (size_t i = 0; (i < ShardCount); i++) {
+            if (used[i]) {
+                locks.emplace_back(shards[i].mutex);
+            }
+        }
+        std::string record, results;
+        Changes changed;
+        for (size_t i = 0; (i < ops.size()); i++) {
+            Shard& shard = shards[hashes[i] % ShardCount];
+            const auto& op = ops[i];
+            switch (op.kind) {
+            case Operation::Kind::Create:
+                results += create(shard, hashes[i], op.account, record,
+                                  changed);
+                break;
+            case Operation::Kind::Credit:
+                results += credit(shard, hashes[i], op.account, op.cents,
+                                  record, changed);
+                break;
+            case Operation::Kind::Debit:
+                results += credit(shard, hashes[i], op.account, -op.cents,
+                                  record, changed);
+                break;
+            case Operation::Kind::Invalid:
+                results += "Invalid operation: " + op.account;
+                break;
+            }
+            results += '\n';
+        }
+        const size_t seq = logRecord(record, changed);
+        locks.clear();
+        commit(seq, changed);
+        os << results;
     }
     
     /**
-     * Outputs a message indicating the status of an account in the bank.
+     * Outputs a message indicating the status of an account in the
+     * bank.  This method does not lock (see the class comment).
      * @param account
      * @param os
      */
-    void getStatus(const std::string& account, std::ostream& os) {
-        auto find = bank.find(account);
-        if (find != bank.end()) {
-            os  << "Account " << account << ": $" << std::fixed 
-                << std::setprecision(2) << find->second;
-        } else {
+    void getStatus(const std::string& account, std::ostream& os) const {
+        const size_t hash = std::hash<std::string>()(account);
+        const Account* acct = find(shards[hash % ShardCount], hash, account);
+        if (acct == nullptr ||
+            !acct->shownOpen.load(std::memory_order_acquire)) {
             os << "Account not found";
+            return;
         }
+        const long long cents =
+            acct->shownCents.load(std::memory_order_relaxed);
+        const long long absCents = (cents < 0 ? -cents : cents);
+        os  << "Account " << account << ": $" << (cents < 0 ? "-" : "")
+            << absCents / 100 << '.' << std::setfill('0') << std::setw(2)
+            << absCents % 100;
     }
+
+    /** Returns the transaction log of the bank (nullptr if none). */
+    const TxnLog* getLog() const { return log; }
     
 private:
-    std::mutex mutex;
-    std::unordered_map<std::string, double> bank;    
+    /** The number of shards.  A power of 2 well above the number of
+        workers, so that unrelated accounts rarely share a shard. */
+    static constexpr size_t ShardCount = 64;
+
+    /** An account.  The name never changes once created.  The latest
+        balance and state are used by writers (holding the lock of the
+        shard) and the committed ones by status reads. */
+    struct Account {
+        explicit Account(const std::string& name) : name(name) {}
+        const std::string name;
+        std::atomic<long long> cents{0};   ///< The balance in cents
+        std::atomic<bool> open{false};     ///< False if reset
+        std::atomic<long long> shownCents{0};  ///< The committed balance
+        std::atomic<bool> shownOpen{false};    ///< The committed state
+        size_t lastSeq = 0;  ///< The record of the latest change
+    };
+
+    /** An entry in a chain of a hash table.  The next entry is set
+        before the entry is published and never changes. */
+    struct Link {
+        Account* acct;
+        const Link* next;
+    };
+
+    /** A hash table of accounts.  When a table becomes full, a table
+        twice as big is published.  Readers may still walk the old
+        one, so it is kept (with its links) until the bank is gone. */
+    struct Table {
+        explicit Table(size_t size) : mask(size - 1),
+            buckets(new std::atomic<const Link*>[size]()) {}
+        const size_t mask;  ///< The number of buckets minus 1
+        std::unique_ptr<std::atomic<const Link*>[]> buckets;
+        std::deque<Link> links;
+    };
+
+    /** A group of accounts with its mutex.  Each shard is on its own
+        cache line(s), so that locking one shard does not slow down
+        threads using a neighbouring shard (false sharing). */
+    struct alignas(64) Shard {
+        Shard() : table(new Table(16)) { tables.emplace_back(table); }
+        std::mutex mutex;
+        std::atomic<Table*> table;  ///< The table used for lookups
+        std::vector<std::unique_ptr<Table>> tables;  ///< All tables
+        std::deque<Account> accounts;  ///< Stable (never moved) cells
+    };
+
+    /** The accounts changed by a transaction, with their shards. */
+    using Changes = std::vector<std::pair<Shard*, Account*>>;
+
+    /**
+     * Logs a record (if the bank has a log and the record is not
+     * empty).  The caller holds the locks of the shards changed.
+     * Without a log, the changes are made visible to status reads
+     * right away.
+     * @param record The record.
+     * @param changed The accounts changed by the record.
+     * @return The sequence number for commit (0 if not logged).
+     */
+    size_t logRecord(const std::string& record, const Changes& changed) {
+        if (log == nullptr || record.empty()) {
+            for (const auto& change : changed) {
+                show(*change.second);
+            }
+            return 0;
+        }
+        const size_t seq = log->append(record);
+        for (const auto& change : changed) {
+            change.second->lastSeq = seq;
+        }
+        return seq;
+    }
+
+    /**
+     * Waits until a logged record is on disk, makes its changes
+     * visible to status reads, and then takes a snapshot if one is
+     * due.  Called without holding any locks.
+     * @param seq The sequence number from logRecord.
+     * @param changed The accounts changed by the record.
+     */
+    void commit(size_t seq, const Changes& changed) {
+        if (seq == 0) {
+            return;
+        }
+        log->wait(seq);
+        // An account changed again since is shown by the commit of
+        // the later record (whose changes are not on disk yet).
+        {
+            std::unique_lock<std::mutex> lock;
+            for (const auto& change : changed) {
+                if (lock.mutex() != &change.first->mutex) {
+                    // One shard at a time, so this cannot deadlock.
+                    if (lock.owns_lock()) {
+                        lock.unlock();
+                    }
+                    lock = std::unique_lock<std::mutex>(change.first->mutex);
+                }
+                if (change.second->lastSeq <= seq) {
+                    show(*change.second);
+                }
+            }
+        }
+        if (log->snapshotDue()) {
+            checkpoint();
+        }
+    }
+
+    /**
+     * Makes the latest balance and state of an account visible to
+     * status reads.  The caller holds the lock of the shard.
+     * @param acct The account.
+     */
+    static void show(Account& acct) {
+        // A reader never sees an account opened with an old balance.
+        if (acct.open.load(std::memory_order_relaxed)) {
+            acct.shownCents.store(acct.cents.load(std::memory_order_relaxed),
+                                  std::memory_order_relaxed);
+            acct.shownOpen.store(true, std::memory_order_release);
+        } else {
+            acct.shownOpen.store(false, std::memory_order_release);
+            acct.shownCents.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * Writes a snapshot of the open accounts to the log.  The shards
+     * are locked (blocking writers, but not status reads) only while
+     * the accounts are copied.
+     */
+    void checkpoint() {
+        std::lock_guard<std::mutex> guard(checkpointMutex);
+        std::string snapshot;
+        size_t segment;
+        {
+            std::vector<std::unique_lock<std::mutex>> locks;
+            for (auto& shard : shards) {
+                locks.emplace_back(shard.mutex);
+            }
+            segment = log->rotate();
+            for (const auto& shard : shards) {
+                for (const auto& acct : shard.accounts) {
+                    if (acct.open.load(std::memory_order_relaxed)) {
+                        encode(snapshot, 'C', acct.name, 0);
+                        encode(snapshot, 'A', acct.name, acct.cents.load());
+                    }
+                }
+            }
+        }
+        log->writeSnapshot(segment, snapshot);
+    }
+
+    /**
+     * Applies a record from the log (during recovery).  A record is a
+     * sequence of changes: "R" (reset), or "C" (create) or "A" (add an
+     * amount) followed by "<cents>,<length>:<account>".
+     * @param record The record.
+     * @return False if the record is invalid.
+     */
+    bool replay(const std::string& record) {
+        std::istringstream is(record);
+        std::string unused;
+        Changes ignored;
+        for (char op; is >> op;) {
+            if (op == 'R') {
+                closeAll(nullptr);
+                continue;
+            }
+            long long cents;
+            size_t len;
+            char comma, colon;
+            if (!(is >> cents >> comma >> len >> colon) || comma != ',' ||
+                colon != ':' || (op != 'C' && op != 'A')) {
+                return false;
+            }
+            std::string account(len, ' ');
+            if (!is.read(&account[0], len)) {
+                return false;
+            }
+            const size_t hash = std::hash<std::string>()(account);
+            Shard& shard = shards[hash % ShardCount];
+            if (op == 'C') {
+                create(shard, hash, account, unused, ignored);
+            } else {
+                credit(shard, hash, account, cents, unused, ignored);
+            }
+        }
+        return true;
+    }
+
+    /** Adds a change to a record (see replay). */
+    static void encode(std::string& record, char op,
+                       const std::string& account, long long cents) {
+        record += op + std::to_string(cents) + ',' +
+            std::to_string(account.size()) + ':' + account;
+    }
+
+    /**
+     * Closes all the accounts.  The caller holds all the locks.
+     * @param changed The list to which the accounts are added
+     * (nullptr during recovery).
+     */
+    void closeAll(Changes* changed) {
+        for (auto& shard : shards) {
+            for (auto& acct : shard.accounts) {
+                acct.open.store(false, std::memory_order_relaxed);
+                acct.cents.store(0, std::memory_order_relaxed);
+                if (changed != nullptr) {
+                    changed->emplace_back(&shard, &acct);
+                }
+            }
+        }
+    }
+
+    /**
+     * Creates (or reopens) an account.  The caller holds the lock of
+     * the shard.
+     * @param shard The shard of the account.
+     * @param hash The hash of the account name.
+     * @param account The name of the account.
+     * @param record The record to which the change is added.
+     * @param changed The list to which the account is added.
+     * @return The message for the client.
+     */
+    static std::string create(Shard& shard, size_t hash,
+                              const std::string& account,
+                              std::string& record, Changes& changed) {
+        Account* acct = find(shard, hash, account);
+        if (acct != nullptr && acct->open.load(std::memory_order_relaxed)) {
+            return "Account " + account + " already exists";
+        }
+        if (acct == nullptr) {
+            acct = add(shard, hash, account);
+        }
+        acct->cents.store(0, std::memory_order_relaxed);
+        acct->open.store(true, std::memory_order_relaxed);
+        changed.emplace_back(&shard, acct);
+        encode(record, 'C', account, 0);
+        return "Account " + account + " created";
+    }
+
+    /**
+     * Adds an amount to the balance of an account.  The caller holds
+     * the lock of the shard.
+     * @param shard The shard of the account.
+     * @param hash The hash of the account name.
+     * @param account The name of the account.
+     * @param cents The amount to be added (negative for debits).
+     * @param record The record to which the change is added.
+     * @param changed The list to which the account is added.
+     * @return The message for the client.
+     */
+    static std::string credit(Shard& shard, size_t hash,
+                              const std::string& account, long long cents,
+                              std::string& record, Changes& changed) {
+        Account* acct = find(shard, hash, account);
+        if (acct == nullptr || !acct->open.load(std::memory_order_relaxed)) {
+            return "Account not found";
+        }
+        acct->cents.fetch_add(cents, std::memory_order_relaxed);
+        changed.emplace_back(&shard, acct);
+        encode(record, 'A', account, cents);
+        return "Account balance updated";
+    }
+
+    /**
+     * Finds an account in a shard, without locking.
+     * @param shard The shard of the account.
+     * @param hash The hash of the account name.
+     * @param account The name of the account.
+     * @return The account or nullptr if it was never created.
+     */
+    static Account* find(const Shard& shard, size_t hash,
+                         const std::string& account) {
+        const Table* table = shard.table.load(std::memory_order_acquire);
+        const auto& bucket = table->buckets[(hash / ShardCount) & table->mask];
+        for (const Link* link = bucket.load(std::memory_order_acquire);
+             link != nullptr; link = link->next) {
+            if (link->acct->name == account) {
+                return link->acct;
+            }
+        }
+        return nullptr;
+    }
+
+    /**
+     * Adds a (closed) account to a shard.  The caller holds the lock
+     * of the shard.
+     * @param shard The shard of the account.
+     * @param hash The hash of the account name.
+     * @param account The name of the account.
+     * @return The new account.
+     */
+    static Account* add(Shard& shard, size_t hash,
+                        const std::string& account) {
+        shard.accounts.emplace_back(account);
+        Account* acct = &shard.accounts.back();
+        Table* table = shard.table.load(std::memory_order_relaxed);
+        if (shard.accounts.size() <= table->mask + 1) {
+            link(*table, hash, acct);
+            return acct;
+        }
+        // Publish a bigger table with all the accounts of the shard.
+        shard.tables.emplace_back(new Table(2 * (table->mask + 1)));
+        table = shard.tables.back().get();
+        for (auto& other : shard.accounts) {
+            link(*table, std::hash<std::string>()(other.name), &other);
+        }
+        shard.table.store(table, std::memory_order_release);
+        return acct;
+    }
+
+    /** Adds an account to the head of its chain in a table. */
+    static void link(Table& table, size_t hash, Account* acct) {
+        auto& bucket = table.buckets[(hash / ShardCount) & table.mask];
+        table.links.push_back({acct, bucket.load(std::memory_order_relaxed)});
+        bucket.store(&table.links.back(), std::memory_order_release);
+    }
+
+    std::array<Shard, ShardCount> shards;
+
+    /** The transaction log (if any) and a mutex so that only one
+        snapshot is written at a time. */
+    TxnLog* const log;
+    std::mutex checkpointMutex;
+};
+
+/** The outcome of reading a request (see extractURL). */
+enum class ReadStatus {
+    /** A request was read. */
+    Ok,
+    /** The client closed the connection (no request was read). */
+    Closed,
+    /** The request cannot be framed (invalid Content-Length). */
+    Bad
 };
 
 /**
  * Reads HTTP headers and extracts the URL and discards any HTTP headers
- * in the inputs. 
+ * (and the body, if any) in the inputs.
  *
  * For example, if the 1st line of input is "GET
  * /http://localhost:8080/~raodm HTTP/1.1" then this method returns
  * "http://localhost:8080/~raodm"
  *
- * @return This method returns the path specified in the GET
- * request.
+ * @param is The input stream to read the request from.
+ * @param url Set to the path specified in the GET request (without
+ * the leading slash).  It is empty for "GET /".
+ * @param keepAlive Set to true if the client wants the connection to
+ * be kept open after the response (the default for HTTP/1.1 unless a
+ * "Connection: close" header is sent).
+ *
+ * @return The outcome.  The body of the request is skipped so that
+ * the next request (on a persistent connection) starts at the
+ * correct place, which is not possible if the status is Bad.
  */
-std::string extractURL(std::istream& is) {
-    std::string line, url;
+ReadStatus extractURL(std::istream& is, std::string& url, bool& keepAlive) {
+    std::string line, version, length;
 
-    // Extract the GET request line from the input
-    std::getline(is, line);
-    
-    // Read and skip HTTP headers. Without reading & skipping HTTP
-    // headers.
-    for (std::string hdr; std::getline(is, hdr) &&
-             !hdr.empty() && hdr != "\r";) {}
+    // Extract the GET request line from the input, skipping any empty
+    // lines before it.
+    while (std::getline(is, line) && (line.empty() || line == "\r")) {}
+    if (!is) {
+        return ReadStatus::Closed;
+    }
 
     // Extract the URL that is delimited by space from the first line of input.
-    std::istringstream(line) >> url >> url;
-    return url.substr(1);
+    url.clear();
+    std::istringstream(line) >> url >> url >> version;
+    keepAlive = (version != "HTTP/1.0");
+
+    // Read HTTP headers and check the Connection and Content-Length
+    // headers. Headers are read upto the blank line.
+    for (std::string hdr; std::getline(is, hdr) &&
+             !hdr.empty() && hdr != "\r";) {
+        std::transform(hdr.begin(), hdr.end(), hdr.begin(), ::tolower);
+        if (hdr.find("connection:") == 0) {
+            keepAlive = (hdr.find("keep-alive") != std::string::npos);
+        } else if (hdr.find("content-length:") == 0) {
+            std::istringstream(hdr.substr(15)) >> length;
+        }
+    }
+    url = (url.empty() ? url : url.substr(1));
+
+    // Skip the body. The length comes from the client, so it is
+    // checked instead of letting std::stoul throw.
+    if (length.size() > 9 ||
+        length.find_first_not_of("0123456789") != std::string::npos) {
+        return ReadStatus::Bad;
+    }
+    char skip[4096];
+    for (size_t left = (length.empty() ? 0 : std::stoul(length));
+         left > 0 && is.read(skip, std::min(left, sizeof(skip)));) {
+        left -= is.gcount();
+    }
+    return ReadStatus::Ok;
+}
+
+/**
+ * Converts an amount of money (e.g., "200" or "12.5") to cents
+ * exactly, without rounding via a double.
+ *
+ * @param amount The amount, with an optional sign and at most 2
+ * digits after the decimal point (e.g., "12.", ".5").  Amounts with
+ * fractions of a cent or an exponent (e.g., "1e3") are rejected.
+ * @return The amount in cents.
+ * @throws std::invalid_argument if the amount is not valid.
+ */
+long long toCents(const std::string& amount) {
+    const size_t start = (!amount.empty() &&
+                          (amount[0] == '-' || amount[0] == '+'));
+    const size_t dot   = std::min(amount.find('.'), amount.size());
+    const size_t fracs = (dot < amount.size() ? amount.size() - dot - 1 : 0);
+    const bool digits  = std::all_of(amount.begin() + start, amount.end(),
+                                     [](unsigned char c) {
+                                         return c == '.' || std::isdigit(c);
+                                     });
+    // At most 15 digits before the point, so the cents cannot overflow.
+    if (!digits || amount.size() - start == (dot < amount.size()) ||
+        dot - start > 15 || fracs > 2 ||
+        amount.find('.', dot + 1) != std::string::npos) {
+        throw std::invalid_argument("Invalid amount: " + amount);
+    }
+    long long cents = 0;
+    for (size_t i = start; (i < amount.size()); i++) {
+        if (i != dot) {
+            cents = cents * 10 + (amount[i] - '0');
+        }
+    }
+    cents *= (fracs == 2 ? 1 : (fracs == 1 ? 10 : 100));
+    return (amount[0] == '-' ? -cents : cents);
+}
+
+/**
+ * Parses the operations of a batch.  The operations are separated by
+ * commas and their fields by colons, e.g.,
+ * "create:0x01,credit:0x01:200,debit:0x01:12.50".  Invalid
+ * operations are kept (as Invalid) so that each operation gets a
+ * result.
+ *
+ * @param ops The operations of the batch.
+ * @return The parsed operations.
+ */
+std::vector<Bank::Operation> parseBatch(const std::string& ops) {
+    using Kind = Bank::Operation::Kind;
+    std::vector<Bank::Operation> batch;
+    std::istringstream is(ops);
+    for (std::string op; std::getline(is, op, ',');) {
+        std::istringstream fields(op);
+        std::string trans, account, amount;
+        std::getline(fields, trans, ':');
+        std::getline(fields, account, ':');
+        const bool hasAmount = static_cast<bool>(std::getline(fields, amount));
+        try {
+            if (trans == "create" && !account.empty() && !hasAmount) {
+                batch.push_back({Kind::Create, account, 0});
+            } else if ((trans == "credit" || trans == "debit") &&
+                       !account.empty() && hasAmount) {
+                batch.push_back({trans == "credit" ? Kind::Credit :
+                                 Kind::Debit, account, toCents(amount)});
+            } else {
+                batch.push_back({Kind::Invalid, op, 0});
+            }
+        } catch (const std::invalid_argument&) {
+            batch.push_back({Kind::Invalid, op, 0});
+        }
+    }
+    return batch;
+}
+
+/**
+ * Applies the transaction given by the URL parameters to a bank.
+ *
+ * @param paramMap The URL parameters.
+ * @param os An output stream to return the modifications to.
+ * @param bank A bank that will be modified.
+ * @throws std::invalid_argument if an amount is not valid.
+ * @throws std::out_of_range if a parameter is missing.
+ */
+void applyTrans(const std::unordered_map<std::string, std::string>& paramMap,
+                std::ostream& os, Bank& bank) {
+    if (paramMap.at("trans") == "reset") {
+        bank.resetBank(os);
+    } else if (paramMap.at("trans") == "create") {
+        bank.createAcct(paramMap.at("acct"), os);
+    } else if (paramMap.at("trans") == "credit") {
+        bank.modifyBalance(paramMap.at("acct"), 
+                toCents(paramMap.at("amount")), os);
+    } else if (paramMap.at("trans") == "debit") {
+        bank.modifyBalance(paramMap.at("acct"), 
+                -toCents(paramMap.at("amount")), os);
+    } else if (paramMap.at("trans") == "status") {
+        bank.getStatus(paramMap.at("acct"), os);
+    } else if (paramMap.at("trans") == "batch") {
+        bank.applyBatch(parseBatch(paramMap.at("ops")), os);
+    }
 }
 
 /**
@@ -145,6 +920,8 @@ std::string extractURL(std::istream& is) {
  * For example.
  * trans=create&acct=0x01
  * Would create a new account '0x01' with a starting balance of $0.00.
+ * And trans=batch&ops=... applies a batch of operations (see
+ * parseBatch).
  * 
  * @param urlParams Parameters in URL format.
  * @param os An output stream to return the modifications to.
@@ -167,22 +944,132 @@ void process(const std::string& urlParams, std::ostream& os, Bank& bank) {
         paramMap[key] = val;
     }
     
-    // Updates the bank based on the URL parameters.
-    if (paramMap.at("trans") == "reset") {
-        bank.resetBank(os);
-    } else if (paramMap.at("trans") == "create") {
-        bank.createAcct(paramMap.at("acct"), os);
-    } else if (paramMap.at("trans") == "credit") {
-        bank.modifyBalance(paramMap.at("acct"), 
-                std::stod(paramMap.at("amount")), os);
-    } else if (paramMap.at("trans") == "debit") {
-        bank.modifyBalance(paramMap.at("acct"), 
-                -std::stod(paramMap.at("amount")), os);
-    } else if (paramMap.at("trans") == "status") {
-        bank.getStatus(paramMap.at("acct"), os);
+    // Updates the bank based on the URL parameters.  Invalid or
+    // missing parameters are reported to the client.
+    try {
+        applyTrans(paramMap, os, bank);
+    } catch (const std::invalid_argument& e) {
+        os << e.what();
+    } catch (const std::out_of_range&) {
+        os << "Missing parameter";
     }
 }
 
+/**
+ * A fixed number of worker threads that serve the connections
+ * accepted by the server.  Accepted connections wait in a bounded
+ * queue until a worker is free.  When the queue is full, connections
+ * are rejected right away (with a 503 response) instead of creating
+ * more threads, so that a burst of connections cannot exhaust memory
+ * or thrash the scheduler.  The workers (and a thread that closes the
+ * rejected connections) are created when the pool is created and run
+ * until the process exits.
+ *
+ * Persistent connections do not hold a worker between requests.  Once
+ * a response is sent, an idle connection is handed to a watcher
+ * thread that waits (in one poll) for the next request on all the
+ * idle connections.  A connection whose next request arrives is
+ * queued again, and one that stays idle for IdleTimeout is closed.
+ */
+class WorkerPool {
+public:
+    /** A connection accepted by the server. */
+    using Client = std::shared_ptr<tcp::iostream>;
+
+    /**
+     * Starts the worker threads.
+     * @param bank The bank used to serve the requests.
+     * @param workers The number of worker threads.
+     * @param maxQueued The maximum number of connections waiting for
+     * a worker.
+     */
+    WorkerPool(Bank& bank, size_t workers, size_t maxQueued);
+
+    /**
+     * Queues a connection to be served by the next free worker.
+     * @param client The connection.
+     * @return False if the queue is full (the connection is not
+     * queued).
+     */
+    bool submit(const Client& client);
+
+    /**
+     * Rejects a connection that could not be queued.  The 503
+     * response is sent right away without blocking.  The connection
+     * is then closed by another thread once the request is read, so
+     * that the accepting thread never waits for the client.
+     * @param client The connection.
+     */
+    void reject(const Client& client);
+
+    /**
+     * Outputs the number of workers, the queue depth, the number of
+     * idle persistent connections, the number of times connections
+     * were served and rejected, and the time connections waited in
+     * the queue.  This is the response to "trans=stats".
+     * @param os The output stream to where the statistics are written.
+     */
+    void report(std::ostream& os) const;
+
+private:
+    /** Shortcut to the clock used to time the waits. */
+    using Clock = std::chrono::steady_clock;
+
+    /** The method run by each worker: serves queued connections. */
+    void work();
+
+    /**
+     * Hands an idle persistent connection to the watcher thread
+     * (watchIdle) to wait for its next request.
+     * @param client The connection.
+     */
+    void park(const Client& client);
+
+    /** The method run by the thread that watches idle connections:
+        queues the ones that become readable and closes the ones that
+        stay idle for too long. */
+    void watchIdle();
+
+    /** The method run by the thread that closes rejected
+        connections. */
+    void closeRejected();
+
+    /** The bank used to serve the requests. */
+    Bank& bank;
+
+    /** The maximum number of connections waiting for a worker. */
+    const size_t maxQueued;
+
+    /** The number of worker threads. */
+    const size_t workers;
+
+    /** The mutex and condition variable guarding the queue and the
+        statistics. */
+    mutable std::mutex mutex;
+    std::condition_variable queued;
+
+    /** The connections waiting for a worker, with the time at which
+        they were accepted. */
+    std::deque<std::pair<Client, Clock::time_point>> queue;
+
+    /** The rejected connections waiting to be closed (and the
+        condition variable signaled when one is added). */
+    std::deque<Client> rejects;
+    std::condition_variable rejectsAdded;
+
+    /** The idle connections handed to watchIdle but not yet seen by
+        it, and an eventfd that wakes it up when one is added. */
+    std::vector<Client> parked;
+    const int wakeFd;
+
+    /** The number of idle connections being watched. */
+    size_t idleCount = 0;
+
+    /** Statistics for report. */
+    size_t served = 0, rejected = 0, maxDepth = 0;
+    double totalWait = 0, maxWait = 0;
+};
+
 /**
  * Process HTTP request that will modify a bank and provide suitable HTTP 
  * response back to the client. 
@@ -190,48 +1077,508 @@ void process(const std::string& urlParams, std::ostream& os, Bank& bank) {
  * @param os The client's output stream which is where the HTTP response will 
  * be sent.
  * @param bank The bank that will be modified.
+ * @param pool The worker pool serving the connection (if any), for
+ * the "trans=stats" request.
+ * @return True if the connection is to be kept open for the next
+ * request.
  */
-void serveClient(std::istream& is, std::ostream& os, Bank& bank) {
+bool serveClient(std::istream& is, std::ostream& os, Bank& bank,
+                 const WorkerPool* pool = nullptr) {
     // Gets the relative url.
+    bool keepAlive = false;
     std::string url;
-    url = url_decode(extractURL(is));
+    const ReadStatus status = extractURL(is, url, keepAlive);
+    if (status == ReadStatus::Closed) {
+        return false;  // The client closed the connection.
+    } else if (status == ReadStatus::Bad) {
+        os << HTTPBadResp << std::flush;
+        return false;
+    }
+    url = url_decode(url);
     
     std::ostringstream oss;
-    process(url, oss, bank);
-    
+    if (pool != nullptr && url == "trans=stats") {
+        pool->report(oss);
+        if (bank.getLog() != nullptr) {
+            bank.getLog()->report(oss << '\n');
+        }
+    } else {
+        process(url, oss, bank);
+    }
     // Gets the data that will be output in the HTTP reponse.
     std::string htmlData = oss.str();
     
     // Formats the http header with the correct length.
     std::string httpHeader = boost::str(boost::format(HTTPRespHeader) %
-                               htmlData.length());
+                               htmlData.length() %
+                               (keepAlive ? "keep-alive" : "Close"));
 
     // Sends the result to the client.
-    os << httpHeader << htmlData;
+    os << httpHeader << htmlData << std::flush;
+    return keepAlive;
+}
+
+WorkerPool::WorkerPool(Bank& bank, size_t workers, size_t maxQueued)
+    : bank(bank), maxQueued(maxQueued), workers(workers),
+      wakeFd(eventfd(0, EFD_CLOEXEC)) {
+    for (size_t i = 0; (i < workers); i++) {
+        std::thread(&WorkerPool::work, this).detach();
+    }
+    std::thread(&WorkerPool::closeRejected, this).detach();
+    std::thread(&WorkerPool::watchIdle, this).detach();
+}
+
+bool WorkerPool::submit(const Client& client) {
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+        if (queue.size() >= maxQueued) {
+            rejected++;
+            return false;
+        }
+        queue.push_back({client, Clock::now()});
+        maxDepth = std::max(maxDepth, queue.size());
+    }
+    queued.notify_one();
+    return true;
+}
+
+void WorkerPool::reject(const Client& client) {
+    // The socket's send buffer is empty, so the short response is
+    // sent in full without blocking.
+    const int sock = client->socket().native_handle();
+    send(sock, HTTPBusyResp.data(), HTTPBusyResp.size(),
+         MSG_DONTWAIT | MSG_NOSIGNAL);
+    shutdown(sock, SHUT_WR);
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+        if (rejects.size() >= maxQueued) {
+            return;  // Too many to drain. The client is reset instead.
+        }
+        rejects.push_back(client);
+    }
+    rejectsAdded.notify_one();
+}
+
+void WorkerPool::closeRejected() {
+    while (true) {
+        Client client;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            rejectsAdded.wait(lock, [this] { return !rejects.empty(); });
+            client = rejects.front();
+            rejects.pop_front();
+        }
+        // The request header is read first (waiting only briefly for
+        // it), as closing a socket with unread data resets the
+        // connection before the client reads the response.
+        client->expires_after(BusyTimeout);
+        for (std::string hdr; std::getline(*client, hdr) &&
+                 !hdr.empty() && hdr != "\r";) {}
+        client->close();
+    }
+}
+
+void WorkerPool::work() {
+    while (true) {
+        Client client;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            queued.wait(lock, [this] { return !queue.empty(); });
+            client = queue.front().first;
+            const double wait = std::chrono::duration<double>(
+                Clock::now() - queue.front().second).count();
+            queue.pop_front();
+            served++;
+            totalWait += wait;
+            maxWait    = std::max(maxWait, wait);
+        }
+        // Serve the requests that are already available (e.g.,
+        // pipelined ones).  Then wait for the next request without
+        // holding this worker.
+        do {
+            client->expires_after(IdleTimeout);
+            if (!serveClient(*client, *client, bank, this)) {
+                client.reset();  // Closed.
+                break;
+            }
+        } while (client->rdbuf()->in_avail() > 0);
+        if (client) {
+            park(client);
+        }
+    }
+}
+
+void WorkerPool::park(const Client& client) {
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+        parked.push_back(client);
+    }
+    const uint64_t one = 1;
+    if (write(wakeFd, &one, sizeof(one)) == -1) {
+        perror("write(eventfd)");
+    }
+}
+
+void WorkerPool::watchIdle() {
+    // The idle connections and the times at which they time out.
+    std::vector<std::pair<Client, Clock::time_point>> idle;
+    std::vector<pollfd> fds;
+    while (true) {
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            for (const auto& client : parked) {
+                idle.push_back({client, Clock::now() + IdleTimeout});
+            }
+            parked.clear();
+            idleCount = idle.size();
+        }
+        // Sleep until a request arrives, a connection is parked, or
+        // the earliest idle timeout.
+        fds.assign(1, {wakeFd, POLLIN, 0});
+        auto deadline = Clock::time_point::max();
+        for (const auto& entry : idle) {
+            fds.push_back({entry.first->socket().native_handle(), POLLIN, 0});
+            deadline = std::min(deadline, entry.second);
+        }
+        // Rounded up, so that poll does not wake just before it.
+        const int timeout = (idle.empty() ? -1 : std::max<long>(0,
+            std::chrono::duration_cast<std::chrono::milliseconds>(
+                deadline - Clock::now() + std::chrono::milliseconds(1) -
+                Clock::duration(1)).count()));
+        if (poll(fds.data(), fds.size(), timeout) == -1) {
+            continue;  // Interrupted.
+        }
+        uint64_t count;
+        if ((fds[0].revents & POLLIN) &&
+            read(wakeFd, &count, sizeof(count)) == -1) {
+            perror("read(eventfd)");
+        }
+        // Queue the connections with a request (or that were closed
+        // by the client) and close the ones that timed out.  Returning
+        // connections are always queued, as they were accepted before.
+        const auto now = Clock::now();
+        std::vector<std::pair<Client, Clock::time_point>> waiting;
+        size_t ready = 0;
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            for (size_t i = 0; (i < idle.size()); i++) {
+                if (fds[i + 1].revents != 0) {
+                    queue.push_back({idle[i].first, now});
+                    ready++;
+                } else if (idle[i].second > now) {
+                    waiting.push_back(std::move(idle[i]));
+                }
+            }
+            maxDepth = std::max(maxDepth, queue.size());
+        }
+        for (; ready > 0; ready--) {
+            queued.notify_one();
+        }
+        idle.swap(waiting);
+    }
+}
+
+void WorkerPool::report(std::ostream& os) const {
+    std::lock_guard<std::mutex> guard(mutex);
+    os << boost::format("Workers: %d, queued: %d of %d (max %d), "
+                        "idle: %d, served: %d, rejected: %d, "
+                        "wait avg: %.3f ms, max: %.3f ms") % workers %
+        queue.size() % maxQueued % maxDepth % idleCount % served % rejected %
+        (served == 0 ? 0.0 : totalWait * 1000 / served) % (maxWait * 1000);
+}
+
+TxnLog::TxnLog(const std::string& dir, std::chrono::microseconds window,
+               size_t snapshotEvery)
+    : dir(dir), window(window), snapshotEvery(snapshotEvery) {
+    // Instance variables are initialized and not assigned!
+}
+
+TxnLog::~TxnLog() {
+    if (thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            stop = true;
+        }
+        wake.notify_one();
+        thread.join();
+        close(fd);
+    }
+}
+
+/**
+ * Helper method to report a failure to write the transaction log.  A
+ * log that could not be written (or synced) cannot be trusted, so
+ * the server stops rather than acknowledge transactions.
+ * @param what The operation that failed.
+ * @param file The file being written.
+ */
+[[noreturn]] void logFailed(const std::string& what,
+                            const std::string& file) {
+    std::cerr << "Error: " << what << " " << file << " failed: "
+              << std::strerror(errno) << std::endl;
+    std::abort();
+}
+
+/**
+ * Helper method to write all of a string to a file.
+ * @param fd The file.
+ * @param data The data to be written.
+ * @return False on errors (errno is set).
+ */
+bool writeAll(int fd, const std::string& data) {
+    for (size_t done = 0; done < data.size();) {
+        const ssize_t n = write(fd, data.data() + done, data.size() - done);
+        if (n == -1 && errno != EINTR) {
+            return false;
+        }
+        done += std::max<ssize_t>(n, 0);
+    }
+    return true;
+}
+
+/**
+ * Helper method to read a whole file into a string.
+ * @param path The file.
+ * @param data The contents of the file.
+ * @return False if the file does not exist (or cannot be read).
+ */
+bool readAll(const std::string& path, std::string& data) {
+    std::ifstream is(path, std::ios::binary);
+    std::ostringstream contents;
+    if (!is.good()) {
+        return false;
+    }
+    if (is.peek() != EOF) {
+        contents << is.rdbuf();
+    }
+    data = contents.str();
+    return true;
+}
+
+void TxnLog::recover(const std::function<bool(const std::string&)>&
+                     apply) {
+    const auto start = Clock::now();
+    // Replays the complete records in a file starting at pos.
+    auto replay = [&](const std::string& data, size_t pos) {
+        while (pos < data.size()) {
+            const size_t colon = data.find(':', pos);
+            const size_t len = std::strtoull(&data[pos], nullptr, 10);
+            if (colon == std::string::npos ||
+                len >= data.size() - colon - 1 ||
+                data[colon + 1 + len] != '\n') {
+                break;  // A record that was only partly written
+            }
+            if (!apply(data.substr(colon + 1, len))) {
+                std::cerr << "Invalid record in transaction log\n";
+                break;
+            }
+            recovered++;
+            pos = colon + 2 + len;
+        }
+    };
+    // The snapshot starts with the first segment after it ("S<n>\n").
+    std::string data;
+    if (readAll(path("snapshot"), data) && !data.empty()) {
+        segment = std::strtoull(&data[1], nullptr, 10);
+        replay(data, data.find('\n') + 1);
+    }
+    for (; readAll(path("log." + std::to_string(segment)), data);
+         segment++) {
+        replay(data, 0);
+    }
+    // New records go to a new segment (after any partly written one).
+    fd = openSegment(segment);
+    recoverySecs = std::chrono::duration<double>(Clock::now() -
+                                                 start).count();
+    startTime = Clock::now();
+    thread = std::thread(&TxnLog::flush, this);
+}
+
+int TxnLog::openSegment(size_t number) const {
+    const std::string file = path("log." + std::to_string(number));
+    const int segFd = open(file.c_str(), O_WRONLY | O_CREAT | O_TRUNC |
+                           O_APPEND | O_CLOEXEC, 0644);
+    if (segFd == -1) {
+        logFailed("Creating", file);
+    }
+    // Sync the directory, so the new file is found after a crash.
+    const int dirFd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dirFd == -1 || fsync(dirFd) == -1) {
+        logFailed("Syncing", dir);
+    }
+    close(dirFd);
+    return segFd;
+}
+
+size_t TxnLog::append(const std::string& record) {
+    size_t seq;
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+        pending += std::to_string(record.size()) + ':' + record + '\n';
+        seq = ++appended;
+        sinceSnapshot++;
+    }
+    wake.notify_one();
+    return seq;
+}
+
+void TxnLog::wait(size_t seq) {
+    std::unique_lock<std::mutex> lock(mutex);
+    flushed.wait(lock, [this, seq] { return synced >= seq; });
+}
+
+bool TxnLog::snapshotDue() {
+    std::lock_guard<std::mutex> guard(mutex);
+    if (sinceSnapshot < snapshotEvery) {
+        return false;
+    }
+    sinceSnapshot = 0;
+    return true;
+}
+
+void TxnLog::flush() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        wake.wait(lock, [this] { return stop || !pending.empty(); });
+        if (pending.empty()) {
+            return;  // Stopped with all the records synced.
+        }
+        // Give concurrent transactions a chance to join this sync.
+        if (window.count() > 0) {
+            wake.wait_for(lock, window, [this] {
+                    return stop || rotating; });
+        }
+        std::string data;
+        data.swap(pending);
+        const size_t upto = appended;
+        flushing = true;
+        lock.unlock();
+        // Appends continue (into pending) while the data is synced.
+        if (!writeAll(fd, data) || fdatasync(fd) == -1) {
+            logFailed("Writing", path("log." + std::to_string(segment)));
+        }
+        lock.lock();
+        flushing = false;
+        synced   = upto;
+        syncs++;
+        flushed.notify_all();
+    }
+}
+
+size_t TxnLog::rotate() {
+    std::unique_lock<std::mutex> lock(mutex);
+    rotating = true;
+    wake.notify_one();
+    flushed.wait(lock, [this] { return pending.empty() && !flushing; });
+    rotating = false;
+    close(fd);
+    fd = openSegment(++segment);
+    return segment;
+}
+
+void TxnLog::writeSnapshot(size_t first, const std::string& data) {
+    const std::string tmp = path("snapshot.tmp");
+    const int snapFd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC |
+                            O_CLOEXEC, 0644);
+    if (snapFd == -1 ||
+        !writeAll(snapFd, "S" + std::to_string(first) + "\n" +
+                  std::to_string(data.size()) + ':' + data + '\n') ||
+        fsync(snapFd) == -1) {
+        logFailed("Writing", tmp);
+    }
+    close(snapFd);
+    // The rename replaces the old snapshot atomically.
+    if (std::rename(tmp.c_str(), path("snapshot").c_str()) == -1) {
+        logFailed("Renaming", tmp);
+    }
+    const int dirFd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dirFd == -1 || fsync(dirFd) == -1) {
+        logFailed("Syncing", dir);
+    }
+    close(dirFd);
+    // Remove the segments included in the snapshot.
+    for (size_t old = first; old-- > 0 &&
+             unlink(path("log." + std::to_string(old)).c_str()) == 0;) {}
+    std::lock_guard<std::mutex> guard(mutex);
+    snapshots++;
+}
+
+void TxnLog::report(std::ostream& os) const {
+    std::lock_guard<std::mutex> guard(mutex);
+    const double secs = std::chrono::duration<double>(Clock::now() -
+                                                      startTime).count();
+    os << boost::format("Log: %s, recovered %d records in %.3f s, "
+                        "commits: %d (%.0f/s since start), syncs: %d (%.1f "
+                        "commits each), window: %d us, snapshots: %d") % dir %
+        recovered % recoverySecs % synced % (synced / secs) % syncs %
+        (syncs == 0 ? 0.0 : double(synced) / syncs) % window.count() %
+        snapshots;
+}
+
+/**
+ * Helper method to read a positive number from an environment
+ * variable.
+ * @param name The name of the environment variable.
+ * @param defValue The value returned if the variable is not set (or
+ * is not a positive number).
+ * @return The number.
+ */
+size_t getEnvSize(const char* name, size_t defValue) {
+    const char* value = std::getenv(name);
+    const long num = (value == nullptr ? 0 : std::atol(value));
+    return (num > 0 ? num : defValue);
 }
 
 /**
  * Top-level method to run a custom HTTP server to process bank
- * transaction requests using multiple threads. Each request should
- * be processed using a separate detached thread. This method just loops 
- * for-ever.
+ * transaction requests using multiple threads.  Connections are
+ * served by a fixed pool of worker threads (see WorkerPool).  The
+ * number of workers and the size of the queue of connections can be
+ * set with the HW7_WORKERS and HW7_QUEUE environment variables.
+ *
+ * If the HW7_LOG environment variable is set to a directory, the
+ * accounts are restored from (and transactions logged to) a
+ * transaction log in that directory.  HW7_COMMIT_US sets how long (in
+ * microseconds, default 0) the log waits for more transactions to
+ * sync together, and HW7_SNAPSHOT the number of transactions between
+ * snapshots (default 100000).  This method just loops for-ever.
  *
  * @param server The boost::tcp::acceptor object to be used to accept
  * connections from various clients.
  */
 void runServer(tcp::acceptor& server) {
+    // The transaction log (if enabled) restores the accounts.
+    std::unique_ptr<TxnLog> log;
+    if (const char* dir = std::getenv("HW7_LOG")) {
+        log.reset(new TxnLog(dir, std::chrono::microseconds(
+                                 getEnvSize("HW7_COMMIT_US", 0)),
+                             getEnvSize("HW7_SNAPSHOT", 100000)));
+    }
+
     // The bank object shared by all the threads!
-    Bank myBank;
-    
-    // Accepts client connections and creates a new thread for each
-    // new connection.
+    Bank myBank(log.get());
+    if (log) {
+        log->report(std::cout);
+        std::cout << std::endl;
+    }
+
+    // Workers mostly wait for clients (rather than compute), so there
+    // are a few per core.
+    const size_t cores = std::max(1u, std::thread::hardware_concurrency());
+    WorkerPool pool(myBank, getEnvSize("HW7_WORKERS", std::max<size_t>(
+                                           16, 4 * cores)),
+                    getEnvSize("HW7_QUEUE", 256));
+
+    // Accepts client connections and queues them for the workers.
     while (true) {
         auto client = std::make_shared<tcp::iostream>();
         server.accept(*client->rdbuf());
-        std::thread thr([client, &myBank]() {
-            serveClient(*client, *client, myBank);
-        });
-        thr.detach();
+        // Responses are written with one flush. Send them right away
+        // instead of waiting for the client to acknowledge earlier ones.
+        client->socket().set_option(tcp::no_delay(true));
+        if (!pool.submit(client)) {
+            pool.reject(client);  // Without waiting for the client.
+        }
     }
 }
 
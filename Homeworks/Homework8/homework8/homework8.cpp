@@ -21,6 +21,9 @@
 #include <mutex>
 #include <iomanip>
 #include <vector>
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
 #include "Stock.h"
 
 // Setup a server socket to accept connections on the socket
@@ -33,13 +36,27 @@ const std::string HTTPRespHeader =
     "HTTP/1.1 200 OK\r\n"
     "Server: BankServer\r\n"
     "Content-Length: %1%\r\n"
-    "Connection: Close\r\n"
+    "Connection: %2%\r\n"
     "Content-Type: text/plain\r\n"
     "\r\n";
 
 // Shortcut to smart pointer with TcpStream
 using TcpStreamPtr = std::shared_ptr<tcp::iostream>;
 
+/** The response sent (before closing the connection) for a request
+    whose body cannot be skipped */
+const std::string HTTPBadResp =
+    "HTTP/1.1 400 Bad Request\r\n"
+    "Server: BankServer\r\n"
+    "Content-Length: 11\r\n"
+    "Connection: Close\r\n"
+    "Content-Type: text/plain\r\n"
+    "\r\n"
+    "Bad request";
+
+/** How long a persistent connection may stay idle between requests */
+const std::chrono::seconds IdleTimeout(15);
+
 // Forward declaration for methods defined further below
 std::string url_decode(std::string);
 
@@ -135,31 +152,75 @@ namespace sm {
     
 }  // namespace sm
 
+/** The outcome of reading a request (see extractURL). */
+enum class ReadStatus {
+    /** A request was read. */
+    Ok,
+    /** The client closed the connection (no request was read). */
+    Closed,
+    /** The request cannot be framed (invalid Content-Length). */
+    Bad
+};
+
 /**
  * Reads HTTP headers and extracts the URL and discards any HTTP headers
- * in the inputs. 
+ * (and the body, if any) in the inputs.
  *
  * For example, if the 1st line of input is "GET
  * /http://localhost:8080/~raodm HTTP/1.1" then this method returns
  * "http://localhost:8080/~raodm"
  *
- * @return This method returns the path specified in the GET
- * request.
+ * @param is The input stream to read the request from.
+ * @param url Set to the path specified in the GET request (without
+ * the leading slash).  It is empty for "GET /".
+ * @param keepAlive Set to true if the client wants the connection to
+ * be kept open after the response (the default for HTTP/1.1 unless a
+ * "Connection: close" header is sent).
+ *
+ * @return The outcome.  The body of the request is skipped so that
+ * the next request (on a persistent connection) starts at the
+ * correct place, which is not possible if the status is Bad.
  */
-std::string extractURL(std::istream& is) {
-    std::string line, url;
+ReadStatus extractURL(std::istream& is, std::string& url, bool& keepAlive) {
+    std::string line, version, length;
 
-    // Extract the GET request line from the input
-    std::getline(is, line);
-    
-    // Read and skip HTTP headers. Without reading & skipping HTTP
-    // headers.
-    for (std::string hdr; std::getline(is, hdr) &&
-             !hdr.empty() && hdr != "\r";) {}
+    // Extract the GET request line from the input, skipping any empty
+    // lines before it.
+    while (std::getline(is, line) && (line.empty() || line == "\r")) {}
+    if (!is) {
+        return ReadStatus::Closed;
+    }
 
     // Extract the URL that is delimited by space from the first line of input.
-    std::istringstream(line) >> url >> url;
-    return url.substr(1);
+    url.clear();
+    std::istringstream(line) >> url >> url >> version;
+    keepAlive = (version != "HTTP/1.0");
+
+    // Read HTTP headers and check the Connection and Content-Length
+    // headers. Headers are read upto the blank line.
+    for (std::string hdr; std::getline(is, hdr) &&
+             !hdr.empty() && hdr != "\r";) {
+        std::transform(hdr.begin(), hdr.end(), hdr.begin(), ::tolower);
+        if (hdr.find("connection:") == 0) {
+            keepAlive = (hdr.find("keep-alive") != std::string::npos);
+        } else if (hdr.find("content-length:") == 0) {
+            std::istringstream(hdr.substr(15)) >> length;
+        }
+    }
+    url = (url.empty() ? url : url.substr(1));
+
+    // Skip the body. The length comes from the client, so it is
+    // checked instead of letting std::stoul throw.
+    if (length.size() > 9 ||
+        length.find_first_not_of("0123456789") != std::string::npos) {
+        return ReadStatus::Bad;
+    }
+    char skip[4096];
+    for (size_t left = (length.empty() ? 0 : std::stoul(length));
+         left > 0 && is.read(skip, std::min(left, sizeof(skip)));) {
+        left -= is.gcount();
+    }
+    return ReadStatus::Ok;
 }
 
 void processCmd(const std::string& cmd, std::ostream& os) {    
@@ -201,32 +262,97 @@ void processCmd(const std::string& cmd, std::ostream& os) {
  * @param is The client's input stream which contains the HTTP request.
  * @param os The client's output stream which is where the HTTP response will 
  * be sent.
- * @param bank The bank that will be modified.
+ * @return True if the connection is to be kept open for the next
+ * request.
  */
-void serveClient(std::istream& is, std::ostream& os) {    
-    sm::threadCount++;
-
+bool serveClient(std::istream& is, std::ostream& os) {    
     // Gets the relative url.
+    bool keepAlive = false;
     std::string url;
-    url = url_decode(extractURL(is));
+    const ReadStatus status = extractURL(is, url, keepAlive);
+    if (status == ReadStatus::Closed) {
+        return false;  // The client closed the connection.
+    } else if (status == ReadStatus::Bad) {
+        os << HTTPBadResp << std::flush;
+        return false;
+    }
+    url = url_decode(url);
     
+    // Invalid or missing parameters (e.g., for "GET /") are reported
+    // to the client.
     std::ostringstream oss;
-    processCmd(url, oss);
+    try {
+        processCmd(url, oss);
+    } catch (const std::invalid_argument&) {
+        oss << "Invalid amount";
+    } catch (const std::out_of_range&) {
+        oss << "Missing parameter";
+    }
     
     // Gets the data that will be output in the HTTP response.
     std::string htmlData = oss.str();
     
     // Formats the http header with the correct length.
     std::string httpHeader = boost::str(boost::format(HTTPRespHeader) %
-                               htmlData.length());
+                               htmlData.length() %
+                               (keepAlive ? "keep-alive" : "Close"));
 
     // Sends the result to the client.
-    os << httpHeader << htmlData;
-    
-    sm::threadCount--;
+    os << httpHeader << htmlData << std::flush;
+    return keepAlive;
+}
+
+/**
+ * Waits until fewer than maxThreads threads are serving requests and
+ * then counts the calling thread as serving.
+ *
+ * \param[in] maxThreads The maximum number of threads that serve
+ * requests at any given time.
+ */
+void acquireSlot(const int maxThreads) {
+    std::unique_lock<std::mutex> lock(sm::mutex);
+    sm::condVar.wait(lock, [maxThreads]{
+        return sm::threadCount < maxThreads; });
+    sm::threadCount++;
+}
+
+/** Counts the calling thread as no longer serving requests and wakes
+    a thread waiting in acquireSlot. */
+void releaseSlot() {
+    {
+        std::lock_guard<std::mutex> lock(sm::mutex);
+        sm::threadCount--;
+    }
     sm::condVar.notify_one();
 }
 
+/**
+ * Serves the requests on a persistent connection until the client
+ * closes it, asks to close it, or stays idle for too long.  The thread
+ * holds a slot (see acquireSlot) only while it serves a request, so
+ * that idle clients do not keep new connections waiting.
+ *
+ * \param[in] client The connection, whose slot was acquired by the
+ * caller.
+ *
+ * \param[in] maxThreads The maximum number of threads that serve
+ * requests at any given time.
+ */
+void serveConnection(TcpStreamPtr client, const int maxThreads) {
+    client->expires_after(IdleTimeout);
+    while (serveClient(*client, *client)) {
+        // Wait for the next request without holding a slot.
+        releaseSlot();
+        client->expires_after(IdleTimeout);
+        if (client->peek() == EOF) {
+            return;  // Closed by the client or idle for too long.
+        }
+        acquireSlot(maxThreads);
+        client->expires_after(IdleTimeout);
+    }
+    releaseSlot();
+}
+
 /**
  * Top-level method to run a custom HTTP server to process stock trade
  * requests using multiple threads. Each request should be processed
@@ -243,18 +369,19 @@ void runServer(tcp::acceptor& server, const int maxThreads) {
     // must use a separate detached thread to process each
     // request.
     while (true) {
-        // Locks the thread and waits to ensure that there are less threads
-        // running that the maxThreads amount.
-        std::unique_lock<std::mutex> lock(sm::mutex);
-        sm::condVar.wait(lock, 
-                [maxThreads]{ return sm::threadCount < maxThreads; });
+        // Waits until fewer than maxThreads threads are serving requests
+        // and reserves a slot for the next connection.  The lock is not
+        // held while accepting, so that idle connections can get their
+        // slot back (see serveConnection).
+        acquireSlot(maxThreads);
         auto client = std::make_shared<tcp::iostream>();
         server.accept(*client->rdbuf());
+        // Responses are written with one flush. Send them right away
+        // instead of waiting for the client to acknowledge earlier ones.
+        client->socket().set_option(tcp::no_delay(true));
         
-        // Creates the new thread.
-        std::thread thr([client]() {
-            serveClient(*client, *client);
-        });
+        // Creates the new thread that serves the connection.
+        std::thread thr(serveConnection, client, maxThreads);
         thr.detach();
     }
     